@@ -0,0 +1,217 @@
+/*
+Benchmark harness for the search engines. Runs the stochastic sampler
+(stochastic_faster.cpp) and optionally brute force (brute_force.cpp) many
+times on each target of a graded corpus, each run a separate process with a
+fixed seed, and writes a JSON report:
+  - time to first solution (both engines run with --first), as min, median,
+    90th percentile and max over the solved runs
+  - candidates per second, when the engine was built with -DARITH_INSTRUMENT
+    (read from the stats file it leaves in $ARITH_STATS)
+  - peak RSS, from wait4
+  - solution cost, mults + 0.25 * adds
+
+  g++ -std=c++17 -O2 -pthread stochastic_faster.cpp -o stochastic_faster
+  g++ -std=c++17 -O2 brute_force.cpp -o brute_force
+  g++ -std=c++17 -O2 benchmark.cpp -o benchmark
+  ./benchmark --runs 10 --out bench.json ./stochastic_faster ./brute_force
+
+Run r of every target uses seed base_seed + r, so two builds see the same
+sequence of searches and their reports can be compared line by line.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+using namespace std;
+
+struct BenchTarget {
+  string grade;
+  string poly;
+  int brute_force_depth; // 0 if brute force can't do it (more than one variable)
+};
+
+const vector<BenchTarget> CORPUS = {
+  {"easy", "a + b + c", 0},
+  {"easy", "a^2 + 2a + 1", 2},
+  {"easy", "ab + 2", 0},
+  {"medium", "a^3 + 6a^2 + 11a + 6", 4},
+  {"medium", "ab + a + b + 1", 0},
+  {"medium", "a^2b + ab^2", 0},
+  {"hard", "a^4 + 4a^3 + 6a^2 + 4a + 1", 4},
+  {"hard", "a^2 + 2ab + b^2 + 2a + 2b + 1", 0},
+};
+
+struct RunResult {
+  bool solved;
+  double seconds;
+  double cost;
+  long peak_rss_kb;
+  double candidates_per_second; // -1 without instrumentation
+};
+
+// value of "key": in a flat JSON object, -1 if it isn't there
+double json_number(const string &text, const string &key) {
+  size_t at = text.find("\"" + key + "\":");
+  if (at == string::npos) return -1;
+  return atof(text.c_str() + at + key.size() + 3);
+}
+
+RunResult run_once(const vector<string> &args, int timeout) {
+  RunResult result = {false, 0, 0, 0, -1};
+  char stats_path[] = "/tmp/arith_bench_XXXXXX";
+  int stats_fd = mkstemp(stats_path);
+  if (stats_fd != -1) close(stats_fd);
+
+  int out[2];
+  if (pipe(out) == -1) {
+    cerr << "pipe failed" << endl;
+    return result;
+  }
+
+  auto start = chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(out[1], STDOUT_FILENO);
+    close(out[0]);
+    close(out[1]);
+    setenv("ARITH_STATS", stats_path, 1);
+    // the alarm survives exec and kills runs that take too long
+    alarm(timeout);
+    vector<char*> argv = {};
+    for (auto &arg : args) argv.push_back((char*) arg.c_str());
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  close(out[1]);
+
+  string output;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(out[0], buffer, sizeof(buffer))) > 0) output.append(buffer, n);
+  close(out[0]);
+
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  result.peak_rss_kb = usage.ru_maxrss;
+
+  size_t adds = output.find("Additions: ");
+  size_t mults = output.find("Multiplications: ");
+  if (WIFEXITED(status) && adds != string::npos && mults != string::npos) {
+    result.solved = true;
+    result.cost = 0.25 * atoi(output.c_str() + adds + 11) + atoi(output.c_str() + mults + 17);
+  }
+
+  ifstream stats(stats_path);
+  stringstream contents;
+  contents << stats.rdbuf();
+  result.candidates_per_second = json_number(contents.str(), "candidates_per_second");
+  unlink(stats_path);
+  return result;
+}
+
+double percentile(vector<double> xs, double p) {
+  sort(xs.begin(), xs.end());
+  size_t i = min(xs.size() - 1, (size_t) (p * (xs.size() - 1) + 0.5));
+  return xs[i];
+}
+
+string distribution(const vector<double> &xs) {
+  if (xs.empty()) return "null";
+  ostringstream out;
+  out << "{\"min\": " << percentile(xs, 0) << ", \"median\": " << percentile(xs, 0.5)
+      << ", \"p90\": " << percentile(xs, 0.9) << ", \"max\": " << percentile(xs, 1) << "}";
+  return out.str();
+}
+
+string report(const BenchTarget &target, const string &engine, const vector<RunResult> &runs) {
+  vector<double> times, costs, rates;
+  long peak_rss = 0;
+  for (auto &run : runs) {
+    peak_rss = max(peak_rss, run.peak_rss_kb);
+    if (run.candidates_per_second >= 0) rates.push_back(run.candidates_per_second);
+    if (!run.solved) continue;
+    times.push_back(run.seconds);
+    costs.push_back(run.cost);
+  }
+  ostringstream out;
+  out << "  {\"target\": \"" << target.poly << "\", \"grade\": \"" << target.grade << "\", \"engine\": \""
+      << engine << "\", \"runs\": " << runs.size() << ", \"solved\": " << times.size() << ",\n"
+      << "   \"time_to_first_solution\": " << distribution(times) << ",\n"
+      << "   \"candidates_per_second\": " << distribution(rates) << ",\n"
+      << "   \"peak_rss_kb\": " << peak_rss << ",\n"
+      << "   \"cost\": " << distribution(costs) << "}";
+  return out.str();
+}
+
+int main(int argc, char **argv) {
+  int runs = 10;
+  unsigned base_seed = 1;
+  int timeout = 120;
+  string out_path = "";
+  vector<string> binaries = {};
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      base_seed = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--timeout") && i + 1 < argc) {
+      timeout = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      binaries.push_back(argv[i]);
+    }
+  }
+  if (binaries.empty() || binaries.size() > 2) {
+    cerr << "usage: benchmark [--runs N] [--seed S] [--timeout SEC] [--out FILE] STOCHASTIC [BRUTE_FORCE]" << endl;
+    return 1;
+  }
+
+  vector<string> entries = {};
+  for (auto &target : CORPUS) {
+    vector<RunResult> results = {};
+    for (int r = 0; r < runs; r++) {
+      results.push_back(run_once({binaries[0], "--target", target.poly, "--seed", to_string(base_seed + r), "--first"}, timeout));
+    }
+    entries.push_back(report(target, "stochastic", results));
+    cerr << target.poly << ": stochastic done" << endl;
+
+    if (binaries.size() < 2 || target.brute_force_depth == 0) continue;
+    // brute force is deterministic, the runs only give a timing distribution
+    results = {};
+    for (int r = 0; r < runs; r++) {
+      results.push_back(run_once({binaries[1], "--target", target.poly, "--depth",
+                                  to_string(target.brute_force_depth), "--first"}, timeout));
+    }
+    entries.push_back(report(target, "brute_force", results));
+    cerr << target.poly << ": brute force done" << endl;
+  }
+
+  ostringstream json;
+  json << "{\"runs_per_target\": " << runs << ", \"base_seed\": " << base_seed << ", \"timeout\": " << timeout
+       << ",\n \"results\": [\n";
+  for (int i = 0; i < entries.size(); i++) {
+    json << entries[i] << (i + 1 < entries.size() ? ",\n" : "\n");
+  }
+  json << "]}\n";
+
+  if (out_path == "") {
+    cout << json.str();
+  } else {
+    ofstream(out_path) << json.str();
+  }
+  return 0;
+}
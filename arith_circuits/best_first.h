@@ -0,0 +1,202 @@
+#ifndef BEST_FIRST_H
+#define BEST_FIRST_H
+
+#include "stochastic_engine.h"
+#include <unordered_map>
+using namespace std;
+
+/*
+Deterministic best-first search over the same moves as the sampler: a state
+is a circuit, and its children combine the root with each node in the pool
+through create_new. States are expanded in order of f = cost + alpha * pred,
+which is A* ordering for alpha = 1 and weighted A* otherwise. The search stops
+once the best f left in open can't beat the best solution. get_pred is not
+admissible, so that solution is only guaranteed optimal for alpha = 0, where
+this is uniform cost search.
+
+A closed set keyed by root fingerprint drops states whose polynomial was
+already reached at no more cost. If open grows past max_open it is cut back to
+its best half, i.e. it degrades into beam search instead of running out of
+memory. With beam_width > 0 the whole search is a beam search that keeps the
+beam_width best states of each depth.
+*/
+
+struct OpenState {
+  float f;
+  float pred;
+  shared_ptr<Circuit> circuit;
+};
+
+struct open_greater {
+  bool operator () (OpenState const& a, OpenState const& b) const {
+    return a.f > b.f;
+  }
+};
+
+class BestFirst {
+  public:
+  Stochastic &engine;
+  unordered_map<uint64_t, float> closed;
+  Circuit best;
+  bool soln;
+  int expansions;
+
+  BestFirst(Stochastic &e) : engine(e) {
+    soln = false;
+    expansions = 0;
+  }
+
+  float pred_of(const Circuit &circuit, uint64_t fp) {
+    uint64_t key = fp ^ engine.table_salt;
+    TableEntry entry;
+    if (engine.table && engine.table->probe(key, entry)) {
+      return entry.pred;
+    }
+    float pred = engine.get_pred(circuit, false);
+    if (engine.table) {
+      engine.table->store(key, pred, false);
+    }
+    return pred;
+  }
+
+  // every child of state that is new, cheaper than the best solution and
+  // can still reach the target. Solutions are recorded instead of returned
+  vector<OpenState> expand(const Circuit &state, int max_cost, float alpha) {
+    expansions += 1;
+    vector<OpenState> children = {};
+    Circuit curr = state;
+    PolyBounds root_bounds = bounds_of(curr.root.poly);
+    for (int n = 0; n < curr.nodes.size(); n++) {
+      PolyBounds node_bounds = bounds_of(curr.nodes[n].poly);
+      for (auto const& oper : {add, mult}) {
+        // children the checks below would throw away anyway
+        float cost = engine.candidate_cost(curr, oper, &curr.root, &curr.nodes[n], true);
+        if (cost >= max_cost || (soln && cost >= best.cost) ||
+            engine.pred_rejects(combine_bounds(oper, root_bounds, node_bounds))) {
+          INSTR_COUNT(PRUNE_BOUND);
+          continue;
+        }
+        Circuit child = engine.create_new(curr, oper, &curr.root, &curr.nodes[n], true);
+        if (child.cost >= max_cost || (soln && child.cost >= best.cost)) {
+          INSTR_COUNT(PRUNE_COST);
+          continue;
+        }
+
+        uint64_t fp = child.root.poly.fingerprint();
+        auto seen = closed.find(fp);
+        if (seen != closed.end() && seen->second <= child.cost) {
+          INSTR_COUNT(PRUNE_CLOSED);
+          continue;
+        }
+        closed[fp] = child.cost;
+
+        if (child.root.poly.poly_map == engine.target.poly_map) {
+          INSTR_COUNT(SOLUTIONS);
+          soln = true;
+          best = child;
+          continue;
+        }
+
+        float pred = pred_of(child, fp);
+        if (pred >= 1000000) {
+          INSTR_COUNT(PRUNE_PRED);
+          continue;
+        }
+        children.push_back({child.cost + alpha * pred, pred, make_shared<Circuit>(child)});
+      }
+    }
+    return children;
+  }
+
+  // one start state per node in the pool, the same ones blank_circuit picks from
+  vector<OpenState> start_states(float alpha) {
+    Circuit pool = engine.blank_circuit({});
+    vector<OpenState> starts = {};
+    for (auto &node : pool.nodes) {
+      Circuit start = {node, 0, pool.nodes};
+      float pred = pred_of(start, node.poly.fingerprint());
+      if (start.root.poly.poly_map == engine.target.poly_map) {
+        soln = true;
+        best = start;
+      }
+      starts.push_back({alpha * pred, pred, make_shared<Circuit>(start)});
+    }
+    return starts;
+  }
+
+  Circuit search(int max_expansions, int max_cost, float alpha, int beam_width, int max_open, bool verbose) {
+    closed = {};
+    soln = false;
+    expansions = 0;
+
+    if (beam_width > 0) {
+      beam_search(max_expansions, max_cost, alpha, beam_width, verbose);
+    } else {
+      vector<OpenState> open = start_states(alpha);
+      make_heap(open.begin(), open.end(), open_greater());
+
+      while (!open.empty() && expansions < max_expansions) {
+        pop_heap(open.begin(), open.end(), open_greater());
+        OpenState top = open.back();
+        open.pop_back();
+        // everything left costs at least this much
+        if (soln && top.f >= best.cost) break;
+
+        for (auto &child : expand(*top.circuit, max_cost, alpha)) {
+          open.push_back(child);
+          push_heap(open.begin(), open.end(), open_greater());
+        }
+
+        if (max_open > 0 && open.size() > max_open) {
+          sort_heap(open.begin(), open.end(), open_greater());
+          reverse(open.begin(), open.end());
+          open.resize(max_open / 2);
+          make_heap(open.begin(), open.end(), open_greater());
+        }
+
+        if (verbose && (expansions % 1000) == 0) {
+          cout << "expansions: " << expansions << " open: " << open.size() << " closed: " << closed.size()
+               << " f: " << top.f << " solution cost: ";
+          if (soln) cout << best.cost << endl;
+          else cout << "None" << endl;
+        }
+      }
+    }
+
+    if (!soln) {
+      // use -100 to flag this is not a solution, same as sample_search
+      return {{}, -100, {}};
+    }
+    return best;
+  }
+
+  void beam_search(int max_expansions, int max_cost, float alpha, int beam_width, bool verbose) {
+    vector<OpenState> beam = start_states(alpha);
+    int depth = 0;
+    while (!beam.empty() && expansions < max_expansions) {
+      vector<OpenState> next = {};
+      for (auto &state : beam) {
+        if (soln && state.f >= best.cost) continue;
+        vector<OpenState> children = expand(*state.circuit, max_cost, alpha);
+        next.insert(next.end(), children.begin(), children.end());
+        if (expansions >= max_expansions) break;
+      }
+      if (next.size() > beam_width) {
+        nth_element(next.begin(), next.begin() + beam_width, next.end(), [](const OpenState &a, const OpenState &b) {
+          return a.f < b.f;
+        });
+        next.resize(beam_width);
+      }
+      beam = next;
+      depth += 1;
+
+      if (verbose) {
+        cout << "depth: " << depth << " beam: " << beam.size() << " expansions: " << expansions << " solution cost: ";
+        if (soln) cout << best.cost << endl;
+        else cout << "None" << endl;
+      }
+    }
+  }
+};
+
+#endif
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstring>
+#include "instrument.h"
+#include "polynomial.h"
 using namespace std;
 
 enum Operation {add, mult, var, constant};
@@ -42,6 +45,7 @@ public:
   }
 
   int grow_to(int max_depth) {
+    INSTR_TIME(T_GROW);
     if (depth >= max_depth) {
       return 0;
     }
@@ -80,6 +84,7 @@ public:
       treesSoFar.insert(treesSoFar.end(), newTrees.begin(), newTrees.end());
       treesSoFar.insert(treesSoFar.end(), sameChild.begin(), sameChild.end());
       growth += newTrees.size();
+      INSTR_ADD(TREES_GROWN, newTrees.size() + sameChild.size());
 
       depth += 1;
     }
@@ -118,6 +123,25 @@ int factorialPoly(int x) {
   return (x + 1) * (x + 2) * (x + 3);
 }
 
+// the --target polynomial, in one variable
+Polynomial target;
+bool has_target = false;
+
+int targetPoly(int x) {
+  if (!has_target) {
+    return factorialPoly(x);
+  }
+  int total = 0;
+  for (auto const& [key, val] : target.poly_map) {
+    int term = val;
+    for (int p = 0; p < key[0]; p++) {
+      term *= x;
+    }
+    total += term;
+  }
+  return total;
+}
+
 int run(Node* root, int input) {
   if (root->op == add) {
     return run(root->op_a, input) + run(root->op_b, input); 
@@ -130,6 +154,16 @@ int run(Node* root, int input) {
   }
 }
 
+bool validTree(Node* root) {
+  INSTR_TIME(T_RUN);
+  for (int j = 0; j < 6; j++) {
+    if (targetPoly(j) != run(root, j)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // determine the number of multiplication operations in the tree
 // used to evaluate each tree
 int countMult(Node* root) {
@@ -142,11 +176,62 @@ int countMult(Node* root) {
   }
 }
 
-int main() {
+int countAdd(Node* root) {
+  if (root == nullptr) {
+    return 0;
+  } else if (root->op == add) {
+    return countAdd(root->op_a) + countAdd(root->op_b) + 1;
+  } else {
+    return countAdd(root->op_a) + countAdd(root->op_b);
+  }
+}
+
+int main(int argc, char **argv) {
+  // --target POLY searches POLY (in a, like Polynomial::print output) instead
+  // of (x + 1)(x + 2)(x + 3)
+  // --depth D grows trees to depth D instead of 3
+  // --first checks each level as soon as it's grown and stops at the first
+  // valid tree, for timing runs (see benchmark.cpp)
+  int max_depth = 3;
+  bool first = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--target") && i + 1 < argc) {
+      if (poly_n_var(argv[i + 1]) > 1 || !parse_poly(argv[i + 1], 1, target)) {
+        cerr << "brute force needs a target in a alone, not " << argv[i + 1] << endl;
+        return 1;
+      }
+      has_target = true;
+      i++;
+    } else if (!strcmp(argv[i], "--depth") && i + 1 < argc) {
+      max_depth = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--first")) {
+      first = true;
+    }
+  }
+
   BruteForce bf = BruteForce({1, 2});
 
+  if (first) {
+    int checked = 0;
+    for (int i = 0; i <= max_depth; i++) {
+      bf.grow_to(i);
+      for (; checked < bf.treesSoFar.size(); checked++) {
+        INSTR_COUNT(CANDIDATES);
+        if (validTree(bf.treesSoFar[checked])) {
+          INSTR_COUNT(SOLUTIONS);
+          printTree(bf.treesSoFar[checked]);
+          cout << "Additions: " << countAdd(bf.treesSoFar[checked]) << endl;
+          cout << "Multiplications: " << countMult(bf.treesSoFar[checked]) << endl;
+          return 0;
+        }
+      }
+    }
+    cout << "NO SOLUTION" << endl;
+    return 0;
+  }
+
   cout << "Total trees at each level: " << endl;
-  for (int i = 0; i < 4; i++) {
+  for (int i = 0; i <= max_depth; i++) {
     bf.grow_to(i);
     cout << i << " " << bf.treesSoFar.size() << endl;
   }
@@ -157,16 +242,10 @@ int main() {
   bool foundValid = false;
 
   for (int i = 0; i < bf.treesSoFar.size(); i++) {
-    bool validTree = true;
-
-    for (int j = 0; j < 6; j++) {
-      if (factorialPoly(j) != run(bf.treesSoFar[i], j)) {
-        validTree = false;
-        break;
-      }
-    }
+    INSTR_COUNT(CANDIDATES);
     
-    if (validTree) {
+    if (validTree(bf.treesSoFar[i])) {
+      INSTR_COUNT(SOLUTIONS);
       if (!foundValid) {
         foundValid = true;
         bestMultCount = countMult(bf.treesSoFar[i]);
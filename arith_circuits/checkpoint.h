@@ -0,0 +1,346 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "circuit.h"
+#include <random>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+/*
+Binary checkpoints of a sample_search run so that it can be resumed after a
+crash or preemption. A checkpoint holds, in order:
+  magic "ACKP", format version
+  the target's n_var and fingerprint, a run is only resumed on its own target
+  the loop counters and current prediction
+  the mt19937 state (624 words + position) and id_counter
+  the current circuit, the best solution and the top-k models, each with the
+  key the heap tells models apart by, which depends on the search mode
+
+Everything is little endian, fixed width and written field by field, so the
+format does not depend on struct layout. Node operand pointers are not saved,
+only the operand ids, since the pointers are only followed while a node is
+being created.
+*/
+
+const uint32_t CHECKPOINT_VERSION = 4;
+
+class ByteWriter {
+  public:
+  string bytes;
+
+  template <typename T>
+  void put(T value) {
+    bytes.append((const char*) &value, sizeof(value));
+  }
+
+  void put_poly(const Polynomial &poly) {
+    put<int32_t>(poly.n_var);
+    put<uint32_t>(poly.poly_map.size());
+    for (auto const& [key, val] : poly.poly_map) {
+      for (int i = 0; i < poly.n_var; i++) {
+        put<int32_t>(key[i]);
+      }
+      put<int32_t>(val);
+    }
+  }
+
+  void put_ids(const set<int> &ids) {
+    put<uint32_t>(ids.size());
+    for (int id : ids) {
+      put<int32_t>(id);
+    }
+  }
+
+  void put_node(const Node &node) {
+    put<uint8_t>(node.op);
+    put<int32_t>(node.arg);
+    put<int32_t>(node.val);
+    put<int32_t>(node.id);
+    put<int32_t>(node.op0_id);
+    put<int32_t>(node.op1_id);
+    put_poly(node.poly);
+    put_ids(node.add_set);
+    put_ids(node.mult_set);
+  }
+
+  void put_circuit(const Circuit &circuit) {
+    put_node(circuit.root);
+    put<float>(circuit.cost);
+    put<uint32_t>(circuit.nodes.size());
+    for (auto &node : circuit.nodes) {
+      put_node(node);
+    }
+  }
+};
+
+class ByteReader {
+  public:
+  const string &bytes;
+  size_t pos;
+  bool ok;
+  int n_var;  // every polynomial has to have this many variables
+
+  ByteReader(const string &b, int n) : bytes(b) {
+    pos = 0;
+    ok = true;
+    n_var = n;
+  }
+
+  template <typename T>
+  T get() {
+    T value = {};
+    if (pos + sizeof(value) > bytes.size()) {
+      ok = false;
+      return value;
+    }
+    memcpy(&value, bytes.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return value;
+  }
+
+  // counts are checked against what is left so a corrupt file can't make
+  // us allocate huge vectors
+  uint32_t get_count(size_t min_item_size) {
+    uint32_t n = get<uint32_t>();
+    if (!ok || (size_t) n * min_item_size > bytes.size() - pos) {
+      ok = false;
+      return 0;
+    }
+    return n;
+  }
+
+  Polynomial get_poly() {
+    // anything else is a corrupt file, and the keys would be read with the
+    // wrong length
+    if (get<int32_t>() != n_var) ok = false;
+    Polynomial poly = Polynomial(n_var);
+    uint32_t n_terms = get_count(4);
+    for (uint32_t t = 0; t < n_terms && ok; t++) {
+      vector<int> key(poly.n_var, 0);
+      for (int i = 0; i < poly.n_var; i++) {
+        key[i] = get<int32_t>();
+      }
+      poly.poly_map[key] = get<int32_t>();
+    }
+    return poly;
+  }
+
+  set<int> get_ids() {
+    set<int> ids = {};
+    uint32_t n = get_count(4);
+    for (uint32_t i = 0; i < n && ok; i++) {
+      ids.insert(get<int32_t>());
+    }
+    return ids;
+  }
+
+  Node get_node() {
+    Node node;
+    node.op = (Operation) get<uint8_t>();
+    node.arg = get<int32_t>();
+    node.val = get<int32_t>();
+    node.id = get<int32_t>();
+    node.op0_id = get<int32_t>();
+    node.op1_id = get<int32_t>();
+    node.op0 = nullptr;
+    node.op1 = nullptr;
+    node.poly = get_poly();
+    node.add_set = get_ids();
+    node.mult_set = get_ids();
+    return node;
+  }
+
+  Circuit get_circuit() {
+    Circuit circuit;
+    circuit.root = get_node();
+    circuit.cost = get<float>();
+    uint32_t n = get_count(1);
+    for (uint32_t i = 0; i < n && ok; i++) {
+      circuit.nodes.push_back(get_node());
+    }
+    return circuit;
+  }
+};
+
+string save_state(const SearchState &s, const mt19937 &gen, const Polynomial &target) {
+  ByteWriter w;
+  w.bytes.append("ACKP", 4);
+  w.put<uint32_t>(CHECKPOINT_VERSION);
+  w.put<int32_t>(target.n_var);
+  w.put<uint64_t>(target.fingerprint());
+
+  w.put<int32_t>(s.iteration);
+  w.put<int32_t>(s.total_iters);
+  w.put<int32_t>(s.solutions_found);
+  w.put<int32_t>(s.restarts);
+  w.put<uint8_t>(s.soln);
+  w.put<float>(s.prev_pred);
+
+  // the standard only exposes the generator state through streams
+  stringstream rng_text;
+  rng_text << gen;
+  uint32_t word;
+  while (rng_text >> word) {
+    w.put<uint32_t>(word);
+  }
+  w.put<int32_t>(id_counter.load());
+
+  w.put_circuit(s.curr);
+  w.put_circuit(s.best);
+  w.put<int32_t>(s.models.capacity);
+  w.put<uint32_t>(s.models.size());
+  for (auto &entry : s.models.heap) {
+    w.put<float>(entry.priority);
+    w.put<uint64_t>(entry.fingerprint);
+    w.put<float>(entry.model->dist);
+    w.put_circuit(entry.model->circuit);
+  }
+  return w.bytes;
+}
+
+// whether bytes is a checkpoint of this format written for target
+bool checkpoint_matches(const string &bytes, const Polynomial &target) {
+  if (bytes.size() < 4 || bytes.compare(0, 4, "ACKP") != 0) return false;
+  ByteReader r(bytes, target.n_var);
+  r.pos = 4;
+  bool matches = r.get<uint32_t>() == CHECKPOINT_VERSION;
+  matches = r.get<int32_t>() == target.n_var && matches;
+  matches = r.get<uint64_t>() == target.fingerprint() && matches;
+  return r.ok && matches;
+}
+
+bool load_state(const string &bytes, SearchState &s, mt19937 &gen, const Polynomial &target) {
+  if (!checkpoint_matches(bytes, target)) return false;
+  ByteReader r(bytes, target.n_var);
+  r.pos = 20;
+
+  SearchState loaded;
+  loaded.iteration = r.get<int32_t>();
+  loaded.total_iters = r.get<int32_t>();
+  loaded.solutions_found = r.get<int32_t>();
+  loaded.restarts = r.get<int32_t>();
+  loaded.soln = r.get<uint8_t>();
+  loaded.prev_pred = r.get<float>();
+
+  stringstream rng_text;
+  for (int i = 0; i < mt19937::state_size + 1; i++) {
+    rng_text << r.get<uint32_t>() << ' ';
+  }
+  int saved_ids = r.get<int32_t>();
+
+  loaded.curr = r.get_circuit();
+  loaded.best = r.get_circuit();
+  loaded.models = ModelHeap<PrioritizedCircuit>(r.get<int32_t>());
+  uint32_t n_models = r.get_count(16);
+  for (uint32_t i = 0; i < n_models && r.ok; i++) {
+    float priority = r.get<float>();
+    uint64_t fp = r.get<uint64_t>();
+    float dist = r.get<float>();
+    Circuit circuit = r.get_circuit();
+    loaded.models.insert(priority, fp, make_shared<PrioritizedCircuit>(PrioritizedCircuit{priority, circuit, dist}));
+  }
+  if (!r.ok) return false;
+
+  mt19937 loaded_gen;
+  rng_text >> loaded_gen;
+  if (rng_text.fail()) return false;
+
+  gen = loaded_gen;
+  s = loaded;
+  // keep new ids clear of the ones in the restored circuits
+  int curr_ids = id_counter.load();
+  while (curr_ids < saved_ids && !id_counter.compare_exchange_weak(curr_ids, saved_ids));
+  return true;
+}
+
+bool read_file(const string &path, string &bytes) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  bytes = "";
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    bytes.append(buf, n);
+  }
+  fclose(f);
+  return true;
+}
+
+/*
+Writes checkpoints from a background thread. submit() only moves the already
+serialized bytes into the pending buffer, so the sampling loop never waits on
+the disk. If the writer is still busy when a newer checkpoint arrives the
+older pending one is dropped. Files are written to path.tmp and renamed over
+path so a crash mid write leaves the previous checkpoint intact.
+*/
+class CheckpointWriter {
+  public:
+  string path;
+  string pending;
+  bool has_pending;
+  bool stopping;
+  mutex m;
+  condition_variable cv;
+  thread worker;
+
+  CheckpointWriter(const string &p) {
+    path = p;
+    has_pending = false;
+    stopping = false;
+    worker = thread([this]() { run(); });
+  }
+
+  ~CheckpointWriter() {
+    {
+      lock_guard<mutex> lock(m);
+      stopping = true;
+    }
+    cv.notify_one();
+    worker.join();
+  }
+
+  void submit(string &bytes) {
+    {
+      lock_guard<mutex> lock(m);
+      pending.swap(bytes);
+      has_pending = true;
+    }
+    cv.notify_one();
+  }
+
+  private:
+  void run() {
+    string writing;
+    while (true) {
+      {
+        unique_lock<mutex> lock(m);
+        cv.wait(lock, [this]() { return has_pending || stopping; });
+        if (!has_pending) return;
+        writing.swap(pending);
+        has_pending = false;
+      }
+      write_file(writing);
+    }
+  }
+
+  void write_file(const string &bytes) {
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+      cerr << "could not write checkpoint " << tmp << endl;
+      return;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+      cerr << "could not write checkpoint " << path << endl;
+    }
+  }
+};
+
+#endif
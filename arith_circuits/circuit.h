@@ -0,0 +1,84 @@
+#ifndef CIRCUIT_H
+#define CIRCUIT_H
+
+#include "polynomial.h"
+#include "model_heap.h"
+#include "value_vector.h"
+#include <set>
+#include <atomic>
+using namespace std;
+
+// ids are handed out from several replica threads when tempering, so the
+// counter has to be atomic
+atomic<int> id_counter(0);
+
+enum Operation {add, mult, var, constant};
+
+const float MULT_COST = 1;
+const float ADD_COST = 0.25;
+
+struct Node {
+  Operation op;
+  int arg;
+  int val;
+  Node* op0;
+  Node* op1;
+  int id;
+  Polynomial poly;
+  set<int> add_set;
+  set<int> mult_set;
+  // op0/op1 usually point into circuits that are gone by now, the ids are
+  // what's left of the structure afterwards. 0 for leaves, ids start at 1
+  int op0_id;
+  int op1_id;
+  // only filled in when the engine runs on value vectors, in which case poly
+  // may be left empty (n_var 0) until the node is kept
+  ValueVector vals;
+};
+
+struct Circuit {
+  Node root;
+  float cost;
+  vector<Node> nodes;
+};
+
+struct PrioritizedCircuit {
+  float priority;
+  Circuit circuit;
+  float dist;
+};
+
+// everything sample_search carries from one iteration to the next, pulled out
+// so that the tempering scheduler can step and swap several of these at once
+struct SearchState {
+  Circuit curr;
+  float prev_pred;
+  ModelHeap<PrioritizedCircuit> models;
+  Circuit best;
+  bool soln;
+  int solutions_found;
+  int total_iters;
+  int restarts;
+  int iteration; // sample_search loop counter, kept here so it can resume
+};
+
+Node get_leaf(int n_var, int arg, int val) {
+  Polynomial poly = Polynomial(n_var);
+  vector<int> powers(n_var, 0); // initialize vector to all 0
+
+  Operation op;
+  if (arg != -1) {
+    powers[arg] = 1;
+    poly.poly_map[powers] = 1;
+    op = var;
+  } else {
+    poly.poly_map[powers] = val;
+    op = constant;
+  }
+
+  int id = ++id_counter;
+  Node leaf = {op, arg, val, nullptr, nullptr, id, poly, {}, {}, 0, 0, {}};
+  return leaf;
+}
+
+#endif
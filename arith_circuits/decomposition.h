@@ -0,0 +1,361 @@
+#ifndef DECOMPOSITION_H
+#define DECOMPOSITION_H
+
+#include "stochastic_engine.h"
+#include <map>
+#include <thread>
+#include <numeric>
+#include <functional>
+using namespace std;
+
+/*
+Splits a search target into smaller targets before searching, then puts the
+pieces' circuits back together as an upper bound for the whole target.
+
+decompose() applies, in order:
+  - the integer content, P = c * Q, so that 2a + 2b is 2 * (a + b) rather
+    than 2a + 2b with two products
+  - additive splits into variable disjoint parts (terms grouped by the
+    variables they share; the constant term goes with the first part)
+  - monomial factors, P = v * Q when every term contains v
+  - linear factors P = (v + r) * Q, found by trying r = 1..max_root as roots
+    of P in v and checking by exact division; repeated roots give repeated
+    factors, which the combined circuit computes once and reuses
+Whatever doesn't split any further is searched on its own by the sampler, all
+pieces in parallel. Contents and roots above the sampler's constants are built
+out of them (see constant_splits), so the combined circuit only uses what the
+sampler could have used and its cost compares with sampled ones.
+
+Coefficients are never negative here, so only negative roots (v + r with r > 0)
+can exist. Factors that aren't linear in a single variable are left to the
+search.
+*/
+
+enum PieceKind {SEARCH, SUM, PRODUCT, CONSTANT, LINEAR};
+
+struct Piece {
+  PieceKind kind;
+  Polynomial poly;
+  int var; // LINEAR: v + val
+  int val; // CONSTANT / LINEAR
+  vector<Piece> children;
+};
+
+Polynomial drop_zeros(const Polynomial &poly) {
+  Polynomial result = Polynomial(poly.n_var);
+  for (auto const& [key, val] : poly.poly_map) {
+    if (val != 0) result.poly_map[key] = val;
+  }
+  return result;
+}
+
+// P / (v + r) if it divides exactly. P is treated as a polynomial in v whose
+// coefficients are polynomials in the other variables
+bool divide_linear(const Polynomial &poly, int v, int r, Polynomial &quotient) {
+  int deg = 0;
+  for (auto const& [key, val] : poly.poly_map) deg = max(deg, key[v]);
+  if (deg == 0) return false;
+
+  // coefficient of v^k, keyed by the exponents with v zeroed
+  vector<map<vector<int>, long long>> coeffs(deg + 1);
+  for (auto const& [key, val] : poly.poly_map) {
+    vector<int> rest = key;
+    rest[v] = 0;
+    coeffs[key[v]][rest] += val;
+  }
+
+  // P = (v + r) Q gives C_k = D_{k-1} + r D_k, so D_{k-1} = C_k - r D_k
+  vector<map<vector<int>, long long>> q(deg);
+  q[deg - 1] = coeffs[deg];
+  for (int k = deg - 1; k >= 1; k--) {
+    q[k - 1] = coeffs[k];
+    for (auto const& [key, val] : q[k]) q[k - 1][key] -= r * val;
+  }
+  // what's left, C_0 - r D_0, has to vanish
+  map<vector<int>, long long> rem = coeffs[0];
+  for (auto const& [key, val] : q[0]) rem[key] -= r * val;
+  for (auto const& [key, val] : rem) {
+    if (val != 0) return false;
+  }
+
+  quotient = Polynomial(poly.n_var);
+  for (int k = 0; k < deg; k++) {
+    for (auto const& [key, val] : q[k]) {
+      if (val == 0) continue;
+      if (val < 0) return false;
+      vector<int> full = key;
+      full[v] = k;
+      quotient.poly_map[full] = val;
+    }
+  }
+  return true;
+}
+
+class Decomposer {
+  public:
+  int max_root;
+
+  Decomposer(int root_bound) {
+    max_root = root_bound;
+  }
+
+  // variable disjoint parts of poly, constant term in the first one
+  vector<Polynomial> additive_parts(const Polynomial &poly) {
+    int n = poly.n_var;
+    vector<int> parent(n);
+    iota(parent.begin(), parent.end(), 0);
+    function<int(int)> find = [&](int x) {
+      return parent[x] == x ? x : parent[x] = find(parent[x]);
+    };
+    for (auto const& [key, val] : poly.poly_map) {
+      int first = -1;
+      for (int i = 0; i < n; i++) {
+        if (key[i] == 0) continue;
+        if (first == -1) first = i;
+        else parent[find(i)] = find(first);
+      }
+    }
+
+    map<int, Polynomial> parts = {};
+    vector<int> constant_key(n, 0);
+    for (auto const& [key, val] : poly.poly_map) {
+      if (key == constant_key) continue;
+      int root = -1;
+      for (int i = 0; i < n && root == -1; i++) {
+        if (key[i] > 0) root = find(i);
+      }
+      if (!parts.count(root)) parts[root] = Polynomial(n);
+      parts[root].poly_map[key] = val;
+    }
+
+    vector<Polynomial> result = {};
+    for (auto const& [root, part] : parts) result.push_back(part);
+    if (poly.poly_map.count(constant_key)) {
+      if (result.empty()) result.push_back(Polynomial(n));
+      result[0].poly_map[constant_key] = poly.poly_map.at(constant_key);
+    }
+    return result;
+  }
+
+  Piece decompose(const Polynomial &input) {
+    Polynomial poly = drop_zeros(input);
+    int n = poly.n_var;
+
+    if (poly.poly_map.size() == 1 && poly.poly_map.begin()->first == vector<int>(n, 0)) {
+      return {CONSTANT, poly, -1, poly.poly_map.begin()->second, {}};
+    }
+
+    int content = 0;
+    for (auto const& [key, val] : poly.poly_map) content = gcd(content, val);
+    if (content > 1) {
+      Polynomial divided = Polynomial(n);
+      for (auto const& [key, val] : poly.poly_map) divided.poly_map[key] = val / content;
+      Piece product = {PRODUCT, poly, -1, 0, {{CONSTANT, Polynomial(n), -1, content, {}}}};
+      Piece rest = decompose(divided);
+      if (rest.kind == PRODUCT) {
+        product.children.insert(product.children.end(), rest.children.begin(), rest.children.end());
+      } else {
+        product.children.push_back(rest);
+      }
+      return product;
+    }
+
+    vector<Polynomial> parts = additive_parts(poly);
+    if (parts.size() > 1) {
+      Piece sum = {SUM, poly, -1, 0, {}};
+      for (auto &part : parts) sum.children.push_back(decompose(part));
+      return sum;
+    }
+
+    // the content is 1 from here on, and dividing by monomials or by
+    // v + r keeps it that way
+    Piece product = {PRODUCT, poly, -1, 0, {}};
+    Polynomial rest = poly;
+
+    for (int v = 0; v < n; v++) {
+      // v itself, while every term has a v in it
+      while (rest.poly_map.size() > 0 && all_of(rest.poly_map.begin(), rest.poly_map.end(),
+                                              [&](auto const& term) { return term.first[v] > 0; })) {
+        Polynomial divided = Polynomial(n);
+        for (auto const& [key, val] : rest.poly_map) {
+          vector<int> lower = key;
+          lower[v] -= 1;
+          divided.poly_map[lower] = val;
+        }
+        rest = divided;
+        product.children.push_back({LINEAR, Polynomial(n), v, 0, {}});
+      }
+      for (int r = 1; r <= max_root; r++) {
+        Polynomial quotient;
+        while (divide_linear(rest, v, r, quotient)) {
+          rest = quotient;
+          product.children.push_back({LINEAR, Polynomial(n), v, r, {}});
+        }
+      }
+    }
+
+    if (product.children.empty()) {
+      return {SEARCH, poly, -1, 0, {}};
+    }
+    bool rest_is_one = rest.poly_map.size() == 1 && rest.poly_map.begin()->first == vector<int>(n, 0)
+                       && rest.poly_map.begin()->second == 1;
+    if (!rest_is_one) {
+      product.children.push_back(decompose(rest));
+    }
+    if (product.children.size() == 1) return product.children[0];
+    return product;
+  }
+
+  void search_pieces(const Piece &piece, vector<Polynomial> &pieces) {
+    if (piece.kind == SEARCH) pieces.push_back(piece.poly);
+    for (auto &child : piece.children) search_pieces(child, pieces);
+  }
+
+  string describe(const Piece &piece) {
+    Polynomial poly = piece.poly;
+    switch (piece.kind) {
+      case CONSTANT: return to_string(piece.val);
+      case LINEAR: return piece.val ? "(" + string(1, letters[piece.var]) + " + " + to_string(piece.val) + ")"
+                                    : string(1, letters[piece.var]);
+      case SEARCH: return "[" + to_string(poly.poly_map.size()) + " terms]";
+      default: break;
+    }
+    string out = "";
+    for (auto &child : piece.children) {
+      if (out != "") out += piece.kind == SUM ? " + " : " * ";
+      out += describe(child);
+    }
+    return piece.kind == SUM ? "(" + out + ")" : out;
+  }
+
+  // how build makes each value up to c out of the constants 1..n_vals:
+  // splits[v] is 0 for those constants, d > 0 for v = d * (v / d) and -b for
+  // v = (v - b) + b, whichever costs least. Sums only add a single constant,
+  // which keeps this close to linear in c
+  vector<int> constant_splits(int c, int n_vals) {
+    vector<float> cost(c + 1, 0);
+    vector<int> splits(c + 1, 0);
+    for (int v = n_vals + 1; v <= c; v++) {
+      cost[v] = numeric_limits<float>::max();
+      for (int b = 1; b <= n_vals; b++) {
+        if (cost[v - b] + ADD_COST < cost[v]) {
+          cost[v] = cost[v - b] + ADD_COST;
+          splits[v] = -b;
+        }
+      }
+      for (int d = 2; d * d <= v; d++) {
+        if (v % d == 0 && cost[d] + cost[v / d] + MULT_COST < cost[v]) {
+          cost[v] = cost[d] + cost[v / d] + MULT_COST;
+          splits[v] = d;
+        }
+      }
+    }
+    return splits;
+  }
+
+  // appends gates for piece to gates, returning the index of its last gate.
+  // memo shares gates between equal subpieces, e.g. repeated factors.
+  // Constants only come from 1..n_vals, like in the sampler
+  int build(const Piece &piece, int n_vals, map<uint64_t, LibraryItem> &solved, vector<LibraryGate> &gates,
+            map<pair<int, uint64_t>, int> &memo, float &cost) {
+    auto leaf = [&](Operation op, int a) {
+      auto key = make_pair((int) op + 4, (uint64_t) a);
+      if (memo.count(key)) return memo[key];
+      LibraryGate gate = {};
+      gate.op = op;
+      gate.a = a;
+      gates.push_back(gate);
+      return memo[key] = gates.size() - 1;
+    };
+    auto combine = [&](Operation op, int a, int b) {
+      LibraryGate gate = {};
+      gate.op = op;
+      gate.a = a;
+      gate.b = b;
+      gates.push_back(gate);
+      cost += op == add ? ADD_COST : MULT_COST;
+      return (int) gates.size() - 1;
+    };
+    // larger constants share the memo entries leaf would give them
+    vector<int> splits = {};
+    function<int(int)> number = [&](int c) {
+      if (c <= n_vals) return leaf(constant, c);
+      auto key = make_pair((int) constant + 4, (uint64_t) c);
+      if (memo.count(key)) return memo[key];
+      if ((int) splits.size() <= c) splits = constant_splits(c, n_vals);
+      int split = splits[c];
+      int made = split > 0 ? combine(mult, number(split), number(c / split))
+                           : combine(add, number(c + split), leaf(constant, -split));
+      return memo[key] = made;
+    };
+
+    if (piece.kind == CONSTANT) return number(piece.val);
+    if (piece.kind == LINEAR) {
+      auto key = make_pair(-1, (uint64_t) piece.var * 1000003 + piece.val);
+      if (memo.count(key)) return memo[key];
+      int v = leaf(var, piece.var);
+      if (piece.val == 0) return memo[key] = v;
+      return memo[key] = combine(add, v, number(piece.val));
+    }
+
+    auto key = make_pair((int) piece.kind, piece.poly.fingerprint());
+    if (memo.count(key)) return memo[key];
+
+    int result = -1;
+    if (piece.kind == SEARCH) {
+      auto found = solved.find(piece.poly.fingerprint());
+      if (found == solved.end()) return -1;
+      int offset = gates.size();
+      for (auto gate : found->second.gates) {
+        if (gate.op == add || gate.op == mult) {
+          gate.a += offset;
+          gate.b += offset;
+        }
+        gates.push_back(gate);
+      }
+      cost += found->second.cost;
+      result = gates.size() - 1;
+    } else {
+      for (auto &child : piece.children) {
+        int c = build(child, n_vals, solved, gates, memo, cost);
+        if (c == -1) return -1;
+        result = result == -1 ? c : combine(piece.kind == SUM ? add : mult, result, c);
+      }
+    }
+    return memo[key] = result;
+  }
+
+  // searches every SEARCH piece with its own sampler, in parallel, and
+  // combines the results into one gate list for the whole target. Returns
+  // false if some piece had no solution
+  bool solve(const Piece &root, int n_vals, int max_iters, int max_cost, int n_models, LibraryItem &result) {
+    vector<Polynomial> pieces = {};
+    search_pieces(root, pieces);
+
+    vector<Circuit> sols(pieces.size());
+    vector<thread> workers = {};
+    for (int i = 0; i < pieces.size(); i++) {
+      workers.push_back(thread([&, i]() {
+        Stochastic engine = Stochastic(pieces[i], n_vals);
+        sols[i] = engine.sample_search(max_iters, max_cost, 1, 1, false, true, n_models, true);
+      }));
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    map<uint64_t, LibraryItem> solved = {};
+    for (int i = 0; i < pieces.size(); i++) {
+      if (sols[i].cost == -100) continue;
+      for (auto &item : circuit_items(sols[i])) {
+        if (item.fingerprint == pieces[i].fingerprint()) solved[item.fingerprint] = item;
+      }
+    }
+
+    result = {root.poly.fingerprint(), 0, root.poly.n_var, {}};
+    map<pair<int, uint64_t>, int> memo = {};
+    return build(root, n_vals, solved, result.gates, memo, result.cost) != -1;
+  }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/*
+Hot path counters and cycle timers for the arith_circuits engines.
+
+Compile with -DARITH_INSTRUMENT to turn them on, otherwise every macro below
+expands to nothing. Each thread bumps its own block of counters, so there is no
+sharing on the hot path; the blocks are only summed when dumping.
+
+The summary is written as JSON to $ARITH_STATS (or stderr) at exit, and again
+whenever the process gets SIGUSR1:
+  INSTR_COUNT(PRUNE_COST);          // bump a counter
+  INSTR_TIME(T_GET_PRED);           // time the rest of the enclosing scope
+*/
+
+#ifdef ARITH_INSTRUMENT
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <csignal>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+using namespace std;
+
+enum InstrCounter {
+  CANDIDATES,     // circuits built by create_new / trees checked by brute force
+  RESTARTS,       // blank_circuit restarts
+  PRUNE_ZERO,     // candidate is the zero polynomial
+  PRUNE_COST,     // over max_cost or not cheaper than the best solution
+  PRUNE_PRED,     // get_pred said it can't reach the target
+  PRUNE_TABLE,    // transposition table already expanded it at <= cost
+  PRUNE_CLOSED,   // best-first closed set already reached it at <= cost
+  PRUNE_BOUND,    // skipped before create_new, operand bounds doom it
+  SOLUTIONS,
+  TREES_GROWN,    // brute force trees generated by grow_to
+  N_COUNTERS
+};
+
+enum InstrTimer {
+  T_CREATE_NEW,
+  T_GET_PRED,
+  T_POLY_MULT,
+  T_BLANK_CIRCUIT,
+  T_GROW,         // brute force grow_to
+  T_RUN,          // brute force evaluation of one tree on all points
+  N_TIMERS
+};
+
+const char* const COUNTER_NAMES[N_COUNTERS] = {
+  "candidates", "restarts", "prune_zero", "prune_cost", "prune_pred", "prune_table", "prune_closed", "prune_bound", "solutions", "trees_grown"
+};
+const char* const TIMER_NAMES[N_TIMERS] = {
+  "create_new", "get_pred", "poly_mult", "blank_circuit", "grow", "run"
+};
+
+inline uint64_t instr_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// only the owning thread writes these, relaxed atomics just make the reads
+// from the dumping thread well defined
+struct InstrBlock {
+  atomic<uint64_t> counts[N_COUNTERS];
+  atomic<uint64_t> calls[N_TIMERS];
+  atomic<uint64_t> cycles[N_TIMERS];
+
+  InstrBlock() {
+    for (auto &c : counts) c.store(0, memory_order_relaxed);
+    for (auto &c : calls) c.store(0, memory_order_relaxed);
+    for (auto &c : cycles) c.store(0, memory_order_relaxed);
+  }
+};
+
+inline void instr_bump(atomic<uint64_t> &c, uint64_t by) {
+  c.store(c.load(memory_order_relaxed) + by, memory_order_relaxed);
+}
+
+class Instrumentation {
+  public:
+  mutex m;
+  // blocks are never freed so that threads which already exited still count
+  vector<InstrBlock*> blocks;
+  chrono::steady_clock::time_point start_time;
+  uint64_t start_cycles;
+
+  static Instrumentation& get() {
+    static Instrumentation *instance = new Instrumentation();
+    return *instance;
+  }
+
+  InstrBlock* register_thread() {
+    lock_guard<mutex> lock(m);
+    blocks.push_back(new InstrBlock());
+    return blocks.back();
+  }
+
+  void dump() {
+    lock_guard<mutex> lock(m);
+    uint64_t counts[N_COUNTERS] = {};
+    uint64_t calls[N_TIMERS] = {};
+    uint64_t cycles[N_TIMERS] = {};
+    for (auto block : blocks) {
+      for (int i = 0; i < N_COUNTERS; i++) counts[i] += block->counts[i].load(memory_order_relaxed);
+      for (int i = 0; i < N_TIMERS; i++) {
+        calls[i] += block->calls[i].load(memory_order_relaxed);
+        cycles[i] += block->cycles[i].load(memory_order_relaxed);
+      }
+    }
+
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    double cycles_per_sec = wall > 0 ? (instr_cycles() - start_cycles) / wall : 0;
+
+    const char *path = getenv("ARITH_STATS");
+    FILE *out = path ? fopen(path, "w") : stderr;
+    if (!out) out = stderr;
+
+    fprintf(out, "{\"wall_seconds\": %.6f, \"threads\": %zu, \"candidates_per_second\": %.1f,\n",
+            wall, blocks.size(), wall > 0 ? counts[CANDIDATES] / wall : 0.0);
+    fprintf(out, " \"counters\": {");
+    for (int i = 0; i < N_COUNTERS; i++) {
+      fprintf(out, "%s\"%s\": %llu", i ? ", " : "", COUNTER_NAMES[i], (unsigned long long) counts[i]);
+    }
+    fprintf(out, "},\n \"timers\": {");
+    for (int i = 0; i < N_TIMERS; i++) {
+      double seconds = cycles_per_sec > 0 ? cycles[i] / cycles_per_sec : 0;
+      fprintf(out, "%s\n  \"%s\": {\"calls\": %llu, \"cycles\": %llu, \"seconds\": %.6f}", i ? "," : "",
+              TIMER_NAMES[i], (unsigned long long) calls[i], (unsigned long long) cycles[i], seconds);
+    }
+    fprintf(out, "}}\n");
+    if (out != stderr) fclose(out);
+    else fflush(out);
+  }
+
+  private:
+  Instrumentation() {
+    start_time = chrono::steady_clock::now();
+    start_cycles = instr_cycles();
+
+    // SIGUSR1 is blocked here, before main starts any threads, so every
+    // thread inherits the mask and only the sigwait thread ever sees it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    thread([set]() {
+      int sig;
+      while (sigwait(&set, &sig) == 0) {
+        Instrumentation::get().dump();
+      }
+    }).detach();
+
+    atexit([]() { Instrumentation::get().dump(); });
+  }
+};
+
+// set up at static init time, see the note on the signal mask above
+[[maybe_unused]] static Instrumentation &instr_init = Instrumentation::get();
+
+inline InstrBlock& instr_block() {
+  static thread_local InstrBlock *block = Instrumentation::get().register_thread();
+  return *block;
+}
+
+class InstrScope {
+  public:
+  InstrTimer timer;
+  uint64_t start;
+
+  InstrScope(InstrTimer t) {
+    timer = t;
+    start = instr_cycles();
+  }
+
+  ~InstrScope() {
+    InstrBlock &block = instr_block();
+    instr_bump(block.calls[timer], 1);
+    instr_bump(block.cycles[timer], instr_cycles() - start);
+  }
+};
+
+#define INSTR_CONCAT2(a, b) a##b
+#define INSTR_CONCAT(a, b) INSTR_CONCAT2(a, b)
+#define INSTR_COUNT(counter) instr_bump(instr_block().counts[counter], 1)
+#define INSTR_ADD(counter, n) instr_bump(instr_block().counts[counter], (n))
+#define INSTR_TIME(timer) InstrScope INSTR_CONCAT(instr_scope_, __LINE__)(timer)
+
+#else
+
+#define INSTR_COUNT(counter) ((void) 0)
+#define INSTR_ADD(counter, n) ((void) 0)
+#define INSTR_TIME(timer) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef MODEL_HEAP_H
+#define MODEL_HEAP_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <limits>
+#include <cstdint>
+using namespace std;
+
+/*
+Fixed capacity min-max heap used for the top-k models pool.
+
+Entries are handles (shared_ptr) so circuits are never copied once they are in
+the pool, and they are deduplicated by polynomial fingerprint instead of by
+priority, so two different polynomials with the same priority are both kept.
+The best (lowest) priority is at index 0 and the worst is at index 1 or 2,
+which makes insertion, eviction of the worst entry and replacing a duplicate
+all O(log k).
+*/
+
+template <typename T>
+class ModelHeap {
+  public:
+  struct Entry {
+    float priority;
+    uint64_t fingerprint;
+    shared_ptr<T> model;
+  };
+
+  int capacity;
+  vector<Entry> heap;
+  unordered_map<uint64_t, int> position;
+
+  ModelHeap(int k = 0) {
+    capacity = k;
+  }
+
+  int size() const {
+    return heap.size();
+  }
+
+  bool full() const {
+    return heap.size() >= capacity;
+  }
+
+  const shared_ptr<T>& best() const {
+    return heap[0].model;
+  }
+
+  float worst_priority() const {
+    return heap[max_index()].priority;
+  }
+
+  // whether insert() would keep a model with this priority and fingerprint,
+  // so callers can skip building the model at all when it wouldn't
+  bool admits(float priority, uint64_t fingerprint) const {
+    if (capacity <= 0) return false;
+    auto it = position.find(fingerprint);
+    if (it != position.end()) {
+      return priority < heap[it->second].priority;
+    }
+    return !full() || priority < worst_priority();
+  }
+
+  bool insert(float priority, uint64_t fingerprint, shared_ptr<T> model) {
+    if (!admits(priority, fingerprint)) return false;
+
+    auto it = position.find(fingerprint);
+    if (it != position.end()) {
+      remove_at(it->second);
+    } else if (full()) {
+      remove_at(max_index());
+    }
+
+    heap.push_back({priority, fingerprint, model});
+    position[fingerprint] = heap.size() - 1;
+    bubble_up(heap.size() - 1);
+    return true;
+  }
+
+  // handles in no particular order
+  vector<shared_ptr<T>> handles() const {
+    vector<shared_ptr<T>> result = {};
+    for (auto &entry : heap) {
+      result.push_back(entry.model);
+    }
+    return result;
+  }
+
+  private:
+  static bool on_min_level(int i) {
+    int level = 0;
+    for (i += 1; i > 1; i >>= 1) level++;
+    return level % 2 == 0;
+  }
+
+  int max_index() const {
+    if (heap.size() == 1) return 0;
+    if (heap.size() == 2) return 1;
+    return heap[1].priority >= heap[2].priority ? 1 : 2;
+  }
+
+  void swap_entries(int i, int j) {
+    swap(heap[i], heap[j]);
+    position[heap[i].fingerprint] = i;
+    position[heap[j].fingerprint] = j;
+  }
+
+  bool better(int i, int j, bool min_level) const {
+    if (min_level) return heap[i].priority < heap[j].priority;
+    return heap[i].priority > heap[j].priority;
+  }
+
+  void bubble_up_level(int i, bool min_level) {
+    while (i > 2) {
+      int grandparent = (((i - 1) / 2) - 1) / 2;
+      if (!better(i, grandparent, min_level)) break;
+      swap_entries(i, grandparent);
+      i = grandparent;
+    }
+  }
+
+  void bubble_up(int i) {
+    if (i == 0) return;
+    int parent = (i - 1) / 2;
+    bool min_level = on_min_level(i);
+    if (min_level ? heap[i].priority > heap[parent].priority : heap[i].priority < heap[parent].priority) {
+      swap_entries(i, parent);
+      bubble_up_level(parent, !min_level);
+    } else {
+      bubble_up_level(i, min_level);
+    }
+  }
+
+  void trickle_down(int i) {
+    bool min_level = on_min_level(i);
+    while (true) {
+      // find the best of the children and grandchildren
+      int m = -1;
+      int first_child = 2 * i + 1;
+      for (int c = first_child; c < first_child + 2 && c < heap.size(); c++) {
+        if (m == -1 || better(c, m, min_level)) m = c;
+        for (int g = 2 * c + 1; g < 2 * c + 3 && g < heap.size(); g++) {
+          if (better(g, m, min_level)) m = g;
+        }
+      }
+      if (m == -1 || !better(m, i, min_level)) return;
+
+      swap_entries(m, i);
+      if (m <= first_child + 1) return; // was a child, nothing below it to fix
+
+      int parent = (m - 1) / 2;
+      if (better(parent, m, min_level)) {
+        swap_entries(m, parent);
+      }
+      i = m;
+    }
+  }
+
+  // move the entry at i to the top of its own kind of level by treating it as
+  // -inf (min level) or +inf (max level), then pop it from there. Swapping an
+  // extreme value past same-kind ancestors never breaks the other invariants
+  void remove_at(int i) {
+    while (i > 2) {
+      int grandparent = (((i - 1) / 2) - 1) / 2;
+      swap_entries(i, grandparent);
+      i = grandparent;
+    }
+    position.erase(heap[i].fingerprint);
+    int last = heap.size() - 1;
+    if (i != last) {
+      heap[i] = heap[last];
+      position[heap[i].fingerprint] = i;
+    }
+    heap.pop_back();
+    if (i < heap.size()) {
+      trickle_down(i);
+    }
+  }
+};
+
+#endif
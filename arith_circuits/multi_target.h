@@ -0,0 +1,133 @@
+#ifndef MULTI_TARGET_H
+#define MULTI_TARGET_H
+
+#include "stochastic_engine.h"
+#include <map>
+#include <thread>
+using namespace std;
+
+/*
+Searches a family of related targets at once, e.g. (x+1)(x+2)...(x+k) for
+several k. Each target gets its own sampler, stepped in its own thread, and
+every iters_per_round steps the solutions and models of all of them are
+pooled as gate lists (the same form the subcircuit library uses). Each sampler
+then rebuilds from the pool whatever could still be useful for its own target,
+so a gate found for one target is offered to the others on their next
+restart. All samplers also share one transposition table, salted per target
+since preds and hits depend on it.
+*/
+
+class MultiTarget {
+  public:
+  vector<Stochastic> engines;
+  vector<SearchState> states;
+  shared_ptr<TranspositionTable> table;
+  // cheapest known circuit per polynomial, across all targets
+  map<uint64_t, LibraryItem> pool;
+  int max_pool_nodes;
+  // (fingerprint, cost) of circuits already split into the pool, so the
+  // models that survive from round to round are only split once
+  set<pair<uint64_t, float>> pooled;
+
+  MultiTarget(const vector<Polynomial> &targets, int n_vals, int table_bits, int pool_nodes)
+    : MultiTarget(targets, n_vals, table_bits, pool_nodes, random_device()()) {}
+
+  // target t's sampler is seeded with seed + t, so a seeded batch is
+  // reproducible
+  MultiTarget(const vector<Polynomial> &targets, int n_vals, int table_bits, int pool_nodes, unsigned seed) {
+    max_pool_nodes = pool_nodes;
+    if (table_bits > 0) {
+      table = make_shared<TranspositionTable>(table_bits);
+    }
+    for (auto &target : targets) {
+      engines.push_back(Stochastic(target, n_vals, seed + engines.size()));
+      engines.back().table = table;
+      engines.back().table_salt = target.fingerprint();
+    }
+  }
+
+  bool add_to_pool(const vector<LibraryItem> &items) {
+    bool changed = false;
+    for (auto &item : items) {
+      auto found = pool.find(item.fingerprint);
+      if (found == pool.end() || item.cost < found->second.cost) {
+        pool[item.fingerprint] = item;
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  bool add_circuit(const Circuit &circuit) {
+    if (!pooled.insert({circuit.root.poly.fingerprint(), circuit.cost}).second) return false;
+    return add_to_pool(circuit_items(circuit));
+  }
+
+  void share(bool force) {
+    bool changed = force;
+    for (auto &s : states) {
+      if (s.soln) changed = add_circuit(s.best) || changed;
+      for (auto &model : s.models.handles()) {
+        changed = add_circuit(model->circuit) || changed;
+      }
+    }
+    if (!changed) return;
+
+    vector<LibraryItem> items = {};
+    for (auto const& [fp, item] : pool) {
+      items.push_back(item);
+    }
+    for (auto &engine : engines) {
+      engine.library_nodes = {};
+      engine.seed_from_items(items, max_pool_nodes);
+    }
+  }
+
+  // a solution per target, in the same order, with cost -100 where none was found
+  vector<Circuit> search(int max_rounds, int iters_per_round, int max_cost, float alpha, float gamma, bool verbose, int n_models) {
+    states = {};
+    if (!pool.empty()) share(true);
+    for (auto &engine : engines) {
+      states.push_back(engine.start_search(n_models));
+    }
+
+    for (int round = 0; round < max_rounds; round++) {
+      vector<thread> workers = {};
+      for (int t = 0; t < engines.size(); t++) {
+        workers.push_back(thread([&, t]() {
+          for (int i = 0; i < iters_per_round; i++) {
+            engines[t].sample_step(states[t], max_cost, alpha, gamma, true, n_models, true);
+          }
+        }));
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      share(false);
+
+      if (verbose && (round % 10) == 0) {
+        cout << "round: " << round + 1 << "/" << max_rounds << " pool: " << pool.size() << endl;
+        for (int t = 0; t < engines.size(); t++) {
+          cout << "target " << t << " pool nodes = " << engines[t].library_nodes.size() << " solution cost: ";
+          if (states[t].soln) cout << states[t].best.cost << endl;
+          else cout << "None" << endl;
+        }
+        cout << endl;
+      }
+    }
+
+    vector<Circuit> solutions = {};
+    for (int t = 0; t < engines.size(); t++) {
+      engines[t].last_models = states[t].models.handles();
+      if (states[t].soln) {
+        solutions.push_back(states[t].best);
+      } else {
+        // use -100 to flag this is not a solution
+        solutions.push_back({{}, -100, {}});
+      }
+    }
+    return solutions;
+  }
+};
+
+#endif
@@ -1,8 +1,15 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
 #include <iostream>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#include "instrument.h"
 using namespace std;
 
 // taken from https://jimmy-shen.medium.com/stl-map-unordered-map-with-a-vector-for-the-key-f30e5f670bae
@@ -38,6 +45,25 @@ class Polynomial {
     poly_map[powers] = coeff;
   }
 
+  // order independent hash of the nonzero terms, so equal polynomials get the
+  // same fingerprint however their maps were built
+  uint64_t fingerprint() const {
+    uint64_t fp = n_var;
+    for (auto const& [key, val] : poly_map) {
+      if (val == 0) continue;
+      uint64_t h = (uint64_t) val;
+      for (auto &power : key) {
+        h = (h ^ (uint64_t) power) * 0x100000001b3;
+      }
+      // splitmix64 finalizer so that summing the terms doesn't cancel out
+      h += 0x9e3779b97f4a7c15;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+      fp += h ^ (h >> 31);
+    }
+    return fp;
+  }
+
   void print() {
     string output = "";
     for (auto const& [key, val] : poly_map) {
@@ -60,7 +86,8 @@ class Polynomial {
   }
 
   const Polynomial& operator + (const Polynomial &obj) const {
-    static Polynomial result = Polynomial(n_var);
+    // thread_local so that engines stepping in parallel don't share the result
+    static thread_local Polynomial result = Polynomial(n_var);
     result.poly_map = poly_map;
 
     for (auto const& [key, val] : obj.poly_map) {
@@ -76,7 +103,7 @@ class Polynomial {
   }
 
   const Polynomial& operator - (const Polynomial &obj) const {
-    static Polynomial result = Polynomial(n_var);
+    static thread_local Polynomial result = Polynomial(n_var);
     result.poly_map = poly_map;
 
     for (auto const& [key, val] : obj.poly_map) {
@@ -92,6 +119,7 @@ class Polynomial {
   }
 
   const Polynomial operator * (const Polynomial &obj) const {
+    INSTR_TIME(T_POLY_MULT);
     Polynomial result = Polynomial(n_var);
     result.poly_map = {};
 
@@ -136,4 +164,69 @@ class Polynomial {
 
 };
 
+// number of variables a polynomial written like print() output uses, i.e.
+// one past the last letter that appears
+int poly_n_var(const string &text) {
+  int n = 0;
+  for (char c : text) {
+    size_t i = letters.find(c);
+    if (i != string::npos) n = max(n, (int) i + 1);
+  }
+  return n;
+}
+
+// reads a polynomial in the same form print() writes, e.g. "1a^3 + 6a^2 + 11a + 6"
+// or "a b + 2c". Repeated terms are summed. Returns false on anything else
+bool parse_poly(const string &text, int n_var, Polynomial &out) {
+  out = Polynomial(n_var);
+  size_t i = 0;
+  auto skip_spaces = [&]() {
+    while (i < text.size() && (text[i] == ' ' || text[i] == '*')) i++;
+  };
+  auto read_int = [&](int &value) {
+    if (i >= text.size() || !isdigit(text[i])) return false;
+    value = 0;
+    while (i < text.size() && isdigit(text[i])) {
+      value = value * 10 + (text[i] - '0');
+      i++;
+    }
+    return true;
+  };
+
+  skip_spaces();
+  if (i == text.size()) return false;
+  while (i < text.size()) {
+    int coeff = 1;
+    bool has_coeff = read_int(coeff);
+    vector<int> powers(n_var, 0);
+    bool has_var = false;
+    skip_spaces();
+    while (i < text.size() && letters.find(text[i]) != string::npos) {
+      int v = letters.find(text[i]);
+      if (v >= n_var) return false;
+      i++;
+      int power = 1;
+      if (i < text.size() && text[i] == '^') {
+        i++;
+        if (!read_int(power)) return false;
+      }
+      powers[v] += power;
+      has_var = true;
+      skip_spaces();
+    }
+    if (!has_coeff && !has_var) return false;
+    out.poly_map[powers] += coeff;
+
+    skip_spaces();
+    if (i < text.size()) {
+      if (text[i] != '+') return false;
+      i++;
+      skip_spaces();
+      if (i == text.size()) return false;
+    }
+  }
+  return true;
+}
+
 
+#endif
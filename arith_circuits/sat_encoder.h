@@ -0,0 +1,455 @@
+#ifndef SAT_ENCODER_H
+#define SAT_ENCODER_H
+
+#include "subcircuit_library.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <random>
+#include <set>
+#include <unistd.h>
+using namespace std;
+
+/*
+Encodes "some straight-line program with n_gates gates, at most max_mults of
+them multiplications, computes the target at these evaluation points" as CNF,
+so that a SAT solver can either find such a program or prove there is none.
+
+Every gate picks add or mult and two operands among the variables, the
+constants 1..n_vals and the gates before it (one-hot selectors). Its value at
+each point is a width bit number, built with ripple-carry adders and a
+shift-and-add multiplier, and the last gate has to equal the target's value
+at every point.
+
+Points are drawn from [1, MAX_POINT], widened by one whenever every point in
+the range has been tried, so every value on the way to the output is at least
+1 and at most the output's value, and width is just enough for the target's
+largest value. Every gate but the last has to be used by a later
+one; sat_search asks about smaller programs first. So UNSAT really means no
+circuit of exactly this size computes the target, while a model only matches
+at the points and has to be checked exactly; if that fails, the caller adds a
+point and solves again, up to MAX_REFINEMENTS times per budget.
+*/
+
+const int MAX_POINT = 7;
+const int MAX_REFINEMENTS = 32;
+
+class CircuitEncoder {
+  public:
+  Polynomial target;
+  int n_var;
+  int n_vals;
+  int n_gates;
+  int max_mults;
+  vector<vector<int>> points;
+  int width;
+
+  int n_cnf_vars = 0;
+  vector<vector<int>> clauses;
+  int true_lit;
+  vector<int> op_var; // true for mult
+  vector<vector<int>> sel_a;
+  vector<vector<int>> sel_b;
+
+  CircuitEncoder(const Polynomial &poly, int vals, int gates, int mults, const vector<vector<int>> &pts) {
+    target = poly;
+    n_var = poly.n_var;
+    n_vals = vals;
+    n_gates = gates;
+    max_mults = mults;
+    points = pts;
+
+    long long largest = 2;
+    for (auto &point : points) largest = max(largest, evaluate(point));
+    width = 0;
+    while ((1LL << width) <= largest) width++;
+  }
+
+  long long evaluate(const vector<int> &point) {
+    long long total = 0;
+    for (auto const& [key, val] : target.poly_map) {
+      long long term = val;
+      for (int i = 0; i < n_var; i++) {
+        for (int p = 0; p < key[i]; p++) term *= point[i];
+      }
+      total += term;
+    }
+    return total;
+  }
+
+  int n_sources(int gate) {
+    return n_var + n_vals + gate;
+  }
+
+  int new_var() {
+    return ++n_cnf_vars;
+  }
+
+  // drops clauses the true literal satisfies and false literals from the rest
+  void add_clause(vector<int> lits) {
+    vector<int> kept = {};
+    for (int lit : lits) {
+      if (lit == true_lit) return;
+      if (lit != -true_lit) kept.push_back(lit);
+    }
+    clauses.push_back(kept);
+  }
+
+  vector<int> constant_bits(long long value) {
+    vector<int> bits(width);
+    for (int w = 0; w < width; w++) bits[w] = (value >> w) & 1 ? true_lit : -true_lit;
+    return bits;
+  }
+
+  int and2(int a, int b) {
+    if (a == -true_lit || b == -true_lit) return -true_lit;
+    if (a == true_lit) return b;
+    if (b == true_lit) return a;
+    int out = new_var();
+    add_clause({-out, a});
+    add_clause({-out, b});
+    add_clause({out, -a, -b});
+    return out;
+  }
+
+  int xor3(int a, int b, int c) {
+    int out = new_var();
+    for (int mask = 0; mask < 8; mask++) {
+      int sa = mask & 1 ? a : -a;
+      int sb = mask & 2 ? b : -b;
+      int sc = mask & 4 ? c : -c;
+      bool odd = __builtin_popcount(mask) & 1;
+      add_clause({-sa, -sb, -sc, odd ? out : -out});
+    }
+    return out;
+  }
+
+  int majority(int a, int b, int c) {
+    int out = new_var();
+    add_clause({-a, -b, out});
+    add_clause({-a, -c, out});
+    add_clause({-b, -c, out});
+    add_clause({a, b, -out});
+    add_clause({a, c, -out});
+    add_clause({b, c, -out});
+    return out;
+  }
+
+  // a + b, with the carry out forbidden unless guard is true
+  vector<int> adder(const vector<int> &a, const vector<int> &b, int guard) {
+    vector<int> sum(width);
+    int carry = -true_lit;
+    for (int w = 0; w < width; w++) {
+      sum[w] = xor3(a[w], b[w], carry);
+      carry = majority(a[w], b[w], carry);
+    }
+    add_clause({guard, -carry});
+    return sum;
+  }
+
+  // a * b, with overflow forbidden unless guard is true
+  vector<int> multiplier(const vector<int> &a, const vector<int> &b, int guard) {
+    vector<int> acc = constant_bits(0);
+    for (int j = 0; j < width; j++) {
+      vector<int> row(width);
+      for (int w = 0; w < width; w++) {
+        row[w] = w < j ? -true_lit : and2(a[w - j], b[j]);
+      }
+      for (int w = width - j; w < width; w++) {
+        add_clause({guard, -a[w], -b[j]});
+      }
+      acc = adder(acc, row, guard);
+    }
+    return acc;
+  }
+
+  void exactly_one(const vector<int> &vars) {
+    add_clause(vars);
+    for (int i = 0; i < vars.size(); i++) {
+      for (int j = i + 1; j < vars.size(); j++) add_clause({-vars[i], -vars[j]});
+    }
+  }
+
+  // sequential counter, at most k of vars true
+  void at_most(const vector<int> &vars, int k) {
+    int n = vars.size();
+    if (k >= n) return;
+    if (k == 0) {
+      for (int v : vars) add_clause({-v});
+      return;
+    }
+    vector<vector<int>> s(n, vector<int>(k));
+    for (int i = 0; i < n - 1; i++) {
+      for (int j = 0; j < k; j++) s[i][j] = new_var();
+    }
+    add_clause({-vars[0], s[0][0]});
+    for (int j = 1; j < k; j++) add_clause({-s[0][j]});
+    for (int i = 1; i < n - 1; i++) {
+      add_clause({-vars[i], s[i][0]});
+      add_clause({-s[i - 1][0], s[i][0]});
+      for (int j = 1; j < k; j++) {
+        add_clause({-vars[i], -s[i - 1][j - 1], s[i][j]});
+        add_clause({-s[i - 1][j], s[i][j]});
+      }
+      add_clause({-vars[i], -s[i - 1][k - 1]});
+    }
+    add_clause({-vars[n - 1], -s[n - 2][k - 1]});
+  }
+
+  // the choice variables come first, the solver in matthew_chaff decides
+  // variables in order and everything else then follows by propagation
+  void encode() {
+    true_lit = new_var();
+    add_clause({true_lit});
+    for (int g = 0; g < n_gates; g++) {
+      op_var.push_back(new_var());
+      vector<int> a, b;
+      for (int s = 0; s < n_sources(g); s++) {
+        a.push_back(new_var());
+        b.push_back(new_var());
+      }
+      sel_a.push_back(a);
+      sel_b.push_back(b);
+    }
+
+    for (int g = 0; g < n_gates; g++) {
+      exactly_one(sel_a[g]);
+      exactly_one(sel_b[g]);
+      // operands are unordered, keep a's index <= b's
+      for (int s = 0; s < n_sources(g); s++) {
+        for (int t = 0; t < s; t++) add_clause({-sel_a[g][s], -sel_b[g][t]});
+      }
+    }
+    at_most(op_var, max_mults);
+    for (int g = 0; g < n_gates - 1; g++) {
+      vector<int> uses = {};
+      for (int h = g + 1; h < n_gates; h++) {
+        uses.push_back(sel_a[h][n_var + n_vals + g]);
+        uses.push_back(sel_b[h][n_var + n_vals + g]);
+      }
+      add_clause(uses);
+    }
+
+    // a leaf bigger than the output can't be on the way to it, and wouldn't
+    // fit in width bits anyway
+    for (auto &point : points) {
+      for (int s = 0; s < n_var + n_vals; s++) {
+        long long value = s < n_var ? point[s] : s - n_var + 1;
+        if (value < (1LL << width)) continue;
+        for (int g = 0; g < n_gates; g++) {
+          add_clause({-sel_a[g][s]});
+          add_clause({-sel_b[g][s]});
+        }
+      }
+    }
+
+    for (auto &point : points) {
+      vector<vector<int>> values = {};
+      for (int i = 0; i < n_var; i++) values.push_back(constant_bits(point[i]));
+      for (int c = 1; c <= n_vals; c++) values.push_back(constant_bits(c));
+
+      for (int g = 0; g < n_gates; g++) {
+        vector<int> a(width), b(width);
+        for (int w = 0; w < width; w++) {
+          a[w] = new_var();
+          b[w] = new_var();
+        }
+        for (int s = 0; s < n_sources(g); s++) {
+          for (int w = 0; w < width; w++) {
+            add_clause({-sel_a[g][s], -values[s][w], a[w]});
+            add_clause({-sel_a[g][s], values[s][w], -a[w]});
+            add_clause({-sel_b[g][s], -values[s][w], b[w]});
+            add_clause({-sel_b[g][s], values[s][w], -b[w]});
+          }
+        }
+
+        int op = op_var[g];
+        vector<int> sum = adder(a, b, op);
+        vector<int> product = multiplier(a, b, -op);
+        vector<int> out(width);
+        for (int w = 0; w < width; w++) {
+          out[w] = new_var();
+          add_clause({-op, -product[w], out[w]});
+          add_clause({-op, product[w], -out[w]});
+          add_clause({op, -sum[w], out[w]});
+          add_clause({op, sum[w], -out[w]});
+        }
+        values.push_back(out);
+      }
+
+      vector<int> wanted = constant_bits(evaluate(point));
+      for (int w = 0; w < width; w++) {
+        add_clause({wanted[w] == true_lit ? values.back()[w] : -values.back()[w]});
+      }
+    }
+  }
+
+  string dimacs() {
+    ostringstream out;
+    out << "c arithmetic circuit, " << n_gates << " gates, <= " << max_mults << " mults, "
+        << points.size() << " points\n";
+    out << "p cnf " << n_cnf_vars << " " << clauses.size() << "\n";
+    for (auto &c : clauses) {
+      for (int lit : c) out << lit << " ";
+      out << "0\n";
+    }
+    return out.str();
+  }
+
+  // the program in model as a gate list like the subcircuit library's
+  vector<LibraryGate> decode(const vector<bool> &model) {
+    auto chosen = [&](const vector<int> &sel) {
+      for (int s = 0; s < sel.size(); s++) {
+        if (model[sel[s]]) return s;
+      }
+      return 0;
+    };
+
+    vector<bool> live(n_gates, false);
+    live[n_gates - 1] = true;
+    for (int g = n_gates - 1; g >= 0; g--) {
+      if (!live[g]) continue;
+      for (int s : {chosen(sel_a[g]), chosen(sel_b[g])}) {
+        if (s >= n_var + n_vals) live[s - n_var - n_vals] = true;
+      }
+    }
+
+    vector<LibraryGate> gates = {};
+    map<int, int> index = {}; // source -> position in gates
+    auto source = [&](int s) {
+      if (index.count(s)) return index[s];
+      LibraryGate gate = {};
+      gate.op = s < n_var ? var : constant;
+      gate.a = s < n_var ? s : s - n_var + 1;
+      gates.push_back(gate);
+      return index[s] = gates.size() - 1;
+    };
+    for (int g = 0; g < n_gates; g++) {
+      if (!live[g]) continue;
+      LibraryGate gate = {};
+      gate.op = model[op_var[g]] ? mult : add;
+      gate.a = source(chosen(sel_a[g]));
+      gate.b = source(chosen(sel_b[g]));
+      gates.push_back(gate);
+      index[n_var + n_vals + g] = gates.size() - 1;
+    }
+    return gates;
+  }
+};
+
+// runs solver (reading DIMACS on stdin, answering SAT with a "v" line or
+// UNSAT) on cnf. Returns 1 with model filled in, 0 for UNSAT, -1 on failure
+int run_solver(const string &solver, const string &cnf, int n_cnf_vars, vector<bool> &model) {
+  char path[] = "/tmp/arith_sat_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    cerr << "could not create a temporary file for the solver" << endl;
+    return -1;
+  }
+  FILE *file = fdopen(fd, "w");
+  fwrite(cnf.data(), 1, cnf.size(), file);
+  fclose(file);
+
+  string command = solver + " < " + path;
+  FILE *pipe = popen(command.c_str(), "r");
+  if (!pipe) {
+    unlink(path);
+    cerr << "could not run " << solver << endl;
+    return -1;
+  }
+  string output;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0) output.append(buffer, n);
+  pclose(pipe);
+  unlink(path);
+
+  istringstream in(output);
+  string token;
+  int result = -1;
+  model.assign(n_cnf_vars + 1, false);
+  while (in >> token) {
+    if (token == "UNSAT" || token == "UNSATISFIABLE") return 0;
+    if (token == "SAT" || token == "SATISFIABLE") result = 1;
+    if (token == "v" || token == "s") continue;
+    if (result == 1 && (isdigit(token[0]) || token[0] == '-')) {
+      int lit = atoi(token.c_str());
+      if (lit > 0 && lit <= n_cnf_vars) model[lit] = true;
+    }
+  }
+  if (result == -1) cerr << "could not make sense of the output of " << solver << endl;
+  return result;
+}
+
+// cheapest circuit for target with at most max_gates gates, by asking the
+// solver about every (gates, mults) budget in order of cost. Each UNSAT
+// answer is a proof that nothing of that cost exists. Returns false if the
+// budgets run out (or the solver fails, or a budget needs more than
+// MAX_REFINEMENTS extra points) first
+bool sat_search(const Polynomial &target, int n_vals, int max_gates, const string &solver,
+                unsigned seed, bool verbose, vector<LibraryGate> &found, float &cost) {
+  int n_var = target.n_var;
+  mt19937 gen(seed);
+  int max_point = MAX_POINT;
+  vector<vector<int>> points = {};
+  set<vector<int>> seen = {};
+  auto add_point = [&]() {
+    // a point already used says nothing new, and with few variables the
+    // range runs out of fresh ones, so it grows until one turns up
+    while (true) {
+      uniform_int_distribution<> distr(1, max_point);
+      vector<int> point(n_var);
+      for (auto &x : point) x = distr(gen);
+      if (seen.insert(point).second) {
+        points.push_back(point);
+        return;
+      }
+      max_point++;
+    }
+  };
+  for (int i = 0; i <= n_var; i++) add_point();
+
+  vector<pair<float, pair<int, int>>> budgets = {};
+  for (int g = 1; g <= max_gates; g++) {
+    for (int k = 0; k <= g; k++) budgets.push_back({MULT_COST * k + ADD_COST * (g - k), {g, k}});
+  }
+  sort(budgets.begin(), budgets.end());
+
+  for (auto &[budget_cost, budget] : budgets) {
+    for (int refinements = 0;; refinements++) {
+      if (refinements > MAX_REFINEMENTS) {
+        cerr << "circuits with " << budget.first << " gates, " << budget.second
+             << " mults still only match at the points after " << MAX_REFINEMENTS
+             << " more, giving up" << endl;
+        return false;
+      }
+      CircuitEncoder encoder = CircuitEncoder(target, n_vals, budget.first, budget.second, points);
+      encoder.encode();
+      vector<bool> model;
+      int result = run_solver(solver, encoder.dimacs(), encoder.n_cnf_vars, model);
+      if (result == -1) return false;
+      if (result == 0) {
+        if (verbose) {
+          cout << "no circuit with " << budget.first << " gates, " << budget.second << " mults (cost "
+               << budget_cost << ")" << endl;
+        }
+        break;
+      }
+      vector<LibraryGate> gates = encoder.decode(model);
+      if (gates_poly(gates, n_var).poly_map == target.poly_map) {
+        found = gates;
+        cost = 0;
+        for (auto &gate : gates) {
+          if (gate.op == add) cost += ADD_COST;
+          if (gate.op == mult) cost += MULT_COST;
+        }
+        return true;
+      }
+      // agrees with the target at the points only, look at one more
+      add_point();
+    }
+  }
+  return false;
+}
+
+#endif
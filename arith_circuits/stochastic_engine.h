@@ -0,0 +1,690 @@
+#ifndef STOCHASTIC_ENGINE_H
+#define STOCHASTIC_ENGINE_H
+
+#include "circuit.h"
+#include "transposition_table.h"
+#include "checkpoint.h"
+#include "subcircuit_library.h"
+#include <set>
+#include <limits>
+#include <random>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+// exact or one-sided facts about a polynomial that carry through add and
+// mult without computing the result. Coefficients are never negative, so
+// nothing cancels: the term count and largest coefficient of a sum or
+// product are at least those of either operand (for products the largest
+// coefficients multiply, the product of the two lexicographically largest
+// such terms can't be reached any other way), and the coefficient sum and
+// total degree are exact
+struct PolyBounds {
+  long long min_terms;
+  long long min_max_coef;
+  long long coeff_sum;
+  int deg;
+};
+
+PolyBounds bounds_of(const Polynomial &poly) {
+  PolyBounds b = {0, 0, 0, 0};
+  for (auto const& [key, val] : poly.poly_map) {
+    if (val == 0) continue;
+    int deg = 0;
+    for (auto &power : key) deg += power;
+    b.min_terms += 1;
+    b.min_max_coef = max(b.min_max_coef, (long long) val);
+    b.coeff_sum += val;
+    b.deg = max(b.deg, deg);
+  }
+  return b;
+}
+
+// the same facts from a value vector's summaries. The coefficient sum and
+// degree are exact, there is a term unless the sum is 0, and the largest
+// coefficient is at least the constant term and the average over at most
+// max_terms terms. Saturated summaries only ever make these smaller
+PolyBounds bounds_of(const ValueVector &vals) {
+  long long terms = max(vals.max_terms, 1LL);
+  return {vals.coeff_sum > 0, max(vals.constant, (vals.coeff_sum + terms - 1) / terms), vals.coeff_sum, vals.total_deg};
+}
+
+PolyBounds combine_bounds(const Operation &op, const PolyBounds &a, const PolyBounds &b) {
+  if (op == add) {
+    return {max(a.min_terms, b.min_terms), max(a.min_max_coef, b.min_max_coef), a.coeff_sum + b.coeff_sum, max(a.deg, b.deg)};
+  }
+  return {max(a.min_terms, b.min_terms), a.min_max_coef * b.min_max_coef, a.coeff_sum * b.coeff_sum, a.deg + b.deg};
+}
+
+// size of the union of two sorted sets
+int union_size(const set<int> &a, const set<int> &b) {
+  int n = 0;
+  auto i = a.begin();
+  auto j = b.begin();
+  while (i != a.end() && j != b.end()) {
+    if (*i < *j) i++;
+    else if (*j < *i) j++;
+    else { i++; j++; }
+    n++;
+  }
+  return n + distance(i, a.end()) + distance(j, b.end());
+}
+
+class Stochastic {
+  public:
+  Polynomial target;
+  int n_var;
+  vector<Node> leaves;
+  int max_val;
+  // each engine owns its generator so that copies of it can run in parallel
+  mt19937 gen;
+  // optional, copies of the engine share it
+  shared_ptr<TranspositionTable> table;
+  // xored into table keys, so engines on different targets can share a
+  // table without mixing up their preds and hits
+  uint64_t table_salt = 0;
+  // nodes rebuilt from a subcircuit library, offered on every restart
+  vector<Node> library_nodes;
+  // the models pool as sample_search left it, for merging into a library
+  vector<shared_ptr<PrioritizedCircuit>> last_models;
+  // candidates carry value vectors instead of polynomials, and the exact
+  // polynomial is only rebuilt for candidates that are moved to, kept as a
+  // model or that look like the target
+  bool use_values = false;
+  vector<array<uint32_t, N_POINTS>> points;
+  ValueVector target_vals;
+  PolyBounds target_bounds;
+  // sample_search returns as soon as it has a solution, for timing runs
+  bool stop_at_first = false;
+
+  Stochastic(const Polynomial &poly, int n_vals) : Stochastic(poly, n_vals, random_device()()) {}
+
+  // a fixed seed makes the whole search reproducible
+  Stochastic(const Polynomial &poly, int n_vals, unsigned seed) {
+    target = poly;
+    n_var = poly.n_var;
+    gen.seed(seed);
+
+    // the root's largest coefficient never shrinks under add or mult, so
+    // anything above the target's is a dead end
+    max_val = 0;
+    for (auto const& [key, val] : target.poly_map) {
+      max_val = max(max_val, val);
+    }
+
+    target_bounds = bounds_of(target);
+    points = random_points(n_var, gen);
+    target_vals = values_of(target, points);
+
+    for (int i = 0; i < n_var; i++) {
+      leaves.push_back(get_leaf(n_var, i, 0));
+    }
+    for (int i = 1; i < n_vals + 1; i++) {
+      leaves.push_back(get_leaf(n_var, -1, i));
+    }
+  }
+
+  Circuit blank_circuit(const vector<shared_ptr<PrioritizedCircuit>> &models) {
+    INSTR_TIME(T_BLANK_CIRCUIT);
+    set<int> seen_ids = {};
+    vector<Node> nodes = {};
+    for (int i = 0; i < leaves.size(); i++) {
+      nodes.push_back(leaves[i]);
+      seen_ids.insert(leaves[i].id);
+    }
+    for (int i = 0; i < library_nodes.size(); i++) {
+      nodes.push_back(library_nodes[i]);
+      seen_ids.insert(library_nodes[i].id);
+    }
+
+    for (int i = 0; i < models.size(); i++) {
+      const Circuit &model = models[i]->circuit;
+      for (int j = 0; j < model.nodes.size(); j++) {
+        int curr_id = model.nodes[j].id;
+        if ((!seen_ids.count(curr_id)) &&  (model.root.add_set.count(curr_id) || model.root.mult_set.count(curr_id))) {
+          seen_ids.insert(curr_id);
+          nodes.push_back(model.nodes[j]);
+        }
+      }
+    }
+
+    uniform_int_distribution<> distr(0, nodes.size() - 1);
+    Circuit newCirc = {nodes[distr(gen)], 0, nodes};
+    return newCirc;
+  }
+
+  float get_pred(const Circuit &circuit, bool simple) {
+    INSTR_TIME(T_GET_PRED);
+    Polynomial r = circuit.root.poly;
+
+    int curr_max = 0;
+    set<vector<int>> s_a = {};
+    for (auto const& [key, val] : r.poly_map) {
+      if (val > curr_max) {
+        curr_max = val;
+      }
+      s_a.insert(key);
+    }
+    if ((r.poly_map.size() > target.poly_map.size()) || (curr_max > max_val)) {
+      return 1000000;
+    }
+
+    Polynomial q = target - r;
+    float d_plus = 0;
+    for (auto const& [key, val] : q.poly_map) {
+      if (val == 0) continue;
+      if (simple && val < 0) {
+        return 1000000;
+      }
+      else {
+        d_plus += sqrt(abs(val));
+      }
+    }
+
+    set<vector<int>> s_p = {};
+    for (auto const& [key, val] : target.poly_map) {
+      s_p.insert(key);
+    }
+    
+    set<vector<int>> unique1;
+    set_difference(s_a.begin(), s_a.end(), s_p.begin(), s_p.end(),
+      inserter(unique1, unique1.end()));
+    set<vector<int>> unique2;
+    set_difference(s_p.begin(), s_p.end(), s_a.begin(), s_a.end(),
+      inserter(unique2, unique2.end()));
+
+    // getting all the terms that are unique to target and r
+    set<vector<int>> unique;
+    set_union(unique1.begin(), unique1.end(), unique2.begin(), unique2.end(),
+      inserter(unique, unique.end()));
+
+    vector<int> temp_sums = {};
+    for (const auto& vec : unique) {
+      int sum = 0;
+      for (const auto& elem : vec) {
+        sum += elem;
+      }
+      temp_sums.push_back(sum);
+    }
+    float d_x = 0;
+    for (const auto& elem : temp_sums) {
+      d_x += elem;
+    }
+
+    float cost = d_plus + d_x;
+    return cost;
+  }
+
+  Circuit create_new(Circuit circuit, const Operation &op, Node* op0, Node* op1, bool track_sets) {
+    INSTR_TIME(T_CREATE_NEW);
+    INSTR_COUNT(CANDIDATES);
+    int id = ++id_counter;
+
+    set<int> add_set;
+    set<int> mult_set;
+    
+    if (track_sets) {
+      set_union(op0->add_set.begin(), op0->add_set.end(), op1->add_set.begin(), op1->add_set.end(),
+        inserter(add_set, add_set.end()));
+      set_union(op0->mult_set.begin(), op0->mult_set.end(), op1->mult_set.begin(), op1->mult_set.end(),
+        inserter(mult_set, mult_set.end()));
+
+      if (op == add) {
+        add_set.insert(id);
+      } else {
+        mult_set.insert(id);
+      }
+    }
+
+    Polynomial newPoly;
+    ValueVector newVals;
+    if (use_values) {
+      ensure_values(*op0);
+      ensure_values(*op1);
+      newVals = op == add ? add_values(op0->vals, op1->vals) : mult_values(op0->vals, op1->vals);
+    } else if (op == add) {
+      newPoly = op0->poly + op1->poly;
+    } else {
+      newPoly = op0->poly * op1->poly;
+    }
+
+    Node newNode = {op, -1, 0, op0, op1, id, newPoly, add_set, mult_set, op0->id, op1->id, newVals};
+
+    float cost = 0;
+    if (op == mult) {
+      cost = circuit.cost + MULT_COST;
+    } else {
+      cost = circuit.cost + ADD_COST;
+    }
+    if (track_sets) {
+      cost = ADD_COST * newNode.add_set.size() + MULT_COST * newNode.mult_set.size();
+    }
+    
+    circuit.nodes.push_back(newNode);
+    Circuit newC = {newNode, cost, circuit.nodes};
+
+    return newC;
+  }
+
+  // the cost create_new will give op0 op op1, computed the same way
+  float candidate_cost(const Circuit &circuit, const Operation &op, const Node* op0, const Node* op1, bool track_sets) {
+    if (track_sets) {
+      int adds = union_size(op0->add_set, op1->add_set) + (op == add);
+      int mults = union_size(op0->mult_set, op1->mult_set) + (op == mult);
+      return ADD_COST * adds + MULT_COST * mults;
+    }
+    return circuit.cost + (op == mult ? MULT_COST : ADD_COST);
+  }
+
+  // get_pred is sure to return 1000000 for anything with these bounds, and
+  // so is approx_pred in value mode
+  bool pred_rejects(const PolyBounds &b) {
+    if (use_values && (b.coeff_sum > target_bounds.coeff_sum || b.deg > target_bounds.deg)) return true;
+    return b.min_terms > target.poly_map.size() || b.min_max_coef > max_val;
+  }
+
+  bool may_be_target(const PolyBounds &b) {
+    return !pred_rejects(b) && b.coeff_sum == target_bounds.coeff_sum && b.deg == target_bounds.deg;
+  }
+
+  // nodes built from a poly (leaves, library nodes, checkpoints) get their
+  // values the first time they're used as operands
+  void ensure_values(Node &node) {
+    if (!node.vals.ready) node.vals = values_of(node.poly, points);
+  }
+
+  // rebuilds the polys create_new skipped in value mode. Operands always come
+  // before the nodes using them in circuit.nodes
+  void ensure_polys(Circuit &circuit) {
+    if (circuit.root.poly.n_var == n_var) return;
+    unordered_map<int, int> index = {};
+    for (int i = 0; i < circuit.nodes.size(); i++) {
+      Node &node = circuit.nodes[i];
+      if (node.poly.n_var != n_var) {
+        const Polynomial &a = circuit.nodes[index[node.op0_id]].poly;
+        const Polynomial &b = circuit.nodes[index[node.op1_id]].poly;
+        node.poly = node.op == add ? a + b : a * b;
+      }
+      index[node.id] = i;
+    }
+    circuit.root.poly = circuit.nodes[index[circuit.root.id]].poly;
+  }
+
+  // get_pred from the exact summaries alone. The coefficient sum only grows
+  // along a circuit, so going over the target's is always a dead end. The
+  // missing coefficient mass is taken as spread evenly over the target's
+  // terms, and every target term of higher degree than the candidate is
+  // certainly missing from it
+  float approx_pred(const ValueVector &vals, bool simple) {
+    if (vals.coeff_sum > target_vals.coeff_sum || vals.total_deg > target_vals.total_deg) {
+      return 1000000;
+    }
+    if (simple && vals.constant > target_vals.constant) {
+      return 1000000;
+    }
+    float d_plus = sqrt((float) (target_vals.coeff_sum - vals.coeff_sum) * target.poly_map.size());
+    float d_x = 0;
+    for (auto const& [key, val] : target.poly_map) {
+      int deg = 0;
+      for (auto &power : key) deg += power;
+      if (deg > vals.total_deg) d_x += deg;
+    }
+    return d_plus + d_x;
+  }
+
+  // whether poly could still be an operand somewhere in a circuit for the
+  // target. Coefficients, per variable degrees and the number of terms can
+  // only grow along a circuit since nothing ever cancels
+  bool could_use(const Polynomial &poly) {
+    if (poly.n_var != n_var || poly.poly_map.size() > target.poly_map.size()) return false;
+    vector<int> max_deg(n_var, 0);
+    for (auto const& [key, val] : target.poly_map) {
+      for (int i = 0; i < n_var; i++) max_deg[i] = max(max_deg[i], key[i]);
+    }
+    for (auto const& [key, val] : poly.poly_map) {
+      if (val > max_val) return false;
+      for (int i = 0; i < n_var; i++) {
+        if (key[i] > max_deg[i]) return false;
+      }
+    }
+    return true;
+  }
+
+  // rebuilds item out of this engine's leaves and library_nodes, adding the
+  // nodes it needs to library_nodes and leaving its root in root. by_fp makes
+  // items that share a subcircuit share its nodes too
+  bool materialize(const LibraryItem &item, unordered_map<uint64_t, int> &by_fp, Node &root) {
+    int n_vals = leaves.size() - n_var;
+    vector<Node> built = {};
+    for (auto &gate : item.gates) {
+      if (gate.op == var) {
+        if (gate.a < 0 || gate.a >= n_var) return false;
+        built.push_back(leaves[gate.a]);
+        continue;
+      }
+      if (gate.op == constant) {
+        if (gate.a < 1 || gate.a > n_vals) return false;
+        built.push_back(leaves[n_var + gate.a - 1]);
+        continue;
+      }
+      if (gate.a < 0 || gate.b < 0 || gate.a >= built.size() || gate.b >= built.size()) return false;
+      const Node &op0 = built[gate.a];
+      const Node &op1 = built[gate.b];
+      Node node;
+      node.op = (Operation) gate.op;
+      node.arg = -1;
+      node.val = 0;
+      node.op0 = nullptr;
+      node.op1 = nullptr;
+      node.poly = node.op == add ? op0.poly + op1.poly : op0.poly * op1.poly;
+
+      uint64_t fp = node.poly.fingerprint();
+      auto found = by_fp.find(fp);
+      if (found != by_fp.end()) {
+        built.push_back(library_nodes[found->second]);
+        continue;
+      }
+      node.id = ++id_counter;
+      node.op0_id = op0.id;
+      node.op1_id = op1.id;
+      set_union(op0.add_set.begin(), op0.add_set.end(), op1.add_set.begin(), op1.add_set.end(),
+        inserter(node.add_set, node.add_set.end()));
+      set_union(op0.mult_set.begin(), op0.mult_set.end(), op1.mult_set.begin(), op1.mult_set.end(),
+        inserter(node.mult_set, node.mult_set.end()));
+      if (node.op == add) {
+        node.add_set.insert(node.id);
+      } else {
+        node.mult_set.insert(node.id);
+      }
+      by_fp[fp] = library_nodes.size();
+      library_nodes.push_back(node);
+      built.push_back(node);
+    }
+    if (built.empty()) return false;
+    root = built.back();
+    return true;
+  }
+
+  // offers the cheapest usable library circuits on every restart, up to
+  // max_nodes nodes in total
+  void seed_from_library(const SubcircuitLibrary &library, int max_nodes) {
+    vector<LibraryItem> items = {};
+    for (size_t i = 0; i < library.size(); i++) {
+      if (library.records[i].n_var == n_var) {
+        items.push_back(library.item(i));
+      }
+    }
+    seed_from_items(items, max_nodes);
+  }
+
+  void seed_from_items(vector<LibraryItem> items, int max_nodes) {
+    sort(items.begin(), items.end(), [](const LibraryItem &a, const LibraryItem &b) {
+      return a.cost < b.cost;
+    });
+
+    unordered_map<uint64_t, int> by_fp = {};
+    for (auto &item : items) {
+      if (item.n_var != n_var || library_nodes.size() + item.gates.size() > max_nodes) continue;
+
+      // unusable items must not leave any of their nodes behind
+      size_t before = library_nodes.size();
+      Node root;
+      if (!materialize(item, by_fp, root) || !could_use(root.poly)) {
+        for (size_t k = before; k < library_nodes.size(); k++) {
+          by_fp.erase(library_nodes[k].poly.fingerprint());
+        }
+        library_nodes.resize(before);
+      }
+    }
+  }
+
+  // every subcircuit of circuit and of the models pool, for merging into a
+  // library
+  vector<LibraryItem> discoveries(const Circuit &circuit) {
+    vector<LibraryItem> items = {};
+    if (circuit.cost != -100 && circuit.nodes.size() > 0) {
+      items = circuit_items(circuit);
+    }
+    for (auto &model : last_models) {
+      vector<LibraryItem> more = circuit_items(model->circuit);
+      items.insert(items.end(), more.begin(), more.end());
+    }
+    return items;
+  }
+
+  SearchState start_search(int n_models) {
+    SearchState s;
+    s.models = ModelHeap<PrioritizedCircuit>(n_models);
+    s.curr = blank_circuit({});
+    s.prev_pred = get_pred(s.curr, false);
+    s.soln = false;
+    s.solutions_found = 0;
+    s.total_iters = 0;
+    s.restarts = 0;
+    s.iteration = 0;
+    return s;
+  }
+
+  // one iteration of sample_search: expand every candidate out of s.curr,
+  // update the models and solution, then move to a weighted random candidate
+  // or restart if there are none
+  void sample_step(SearchState &s, int max_cost, float alpha, float gamma, bool use_pred, int n_models, bool wrapped) {
+    vector<Circuit> circs = {};
+    vector<float> preds = {};
+    vector<float> weights = {};
+    vector<uint64_t> keys = {};
+
+    // candidates that are certain to be pruned below aren't built at all,
+    // which skips the product and the copy of the circuit. In value mode the
+    // bounds come from the candidate's own summaries, which only take a pass
+    // over the points
+    PolyBounds root_bounds;
+    if (use_values) ensure_values(s.curr.root);
+    else root_bounds = bounds_of(s.curr.root.poly);
+
+    for (int n = 0; n < s.curr.nodes.size(); n++) {
+      PolyBounds node_bounds;
+      if (use_values) ensure_values(s.curr.nodes[n]);
+      else node_bounds = bounds_of(s.curr.nodes[n].poly);
+      for (auto const& oper : {add, mult}) {
+        s.total_iters += 1;
+        PolyBounds b;
+        if (use_values) {
+          const ValueVector &x = s.curr.root.vals, &y = s.curr.nodes[n].vals;
+          b = bounds_of(oper == add ? add_values(x, y) : mult_values(x, y));
+        } else {
+          b = combine_bounds(oper, root_bounds, node_bounds);
+        }
+        float cost = candidate_cost(s.curr, oper, &s.curr.root, &s.curr.nodes[n], n_models > 0);
+        bool cost_pruned = cost >= max_cost || (s.soln && cost >= s.best.cost - 1);
+        if (!may_be_target(b) && (cost_pruned || pred_rejects(b))) {
+          INSTR_COUNT(PRUNE_BOUND);
+          continue;
+        }
+        Circuit newCirc = create_new(s.curr, oper, &s.curr.root, &s.curr.nodes[n], n_models > 0);
+
+        int new_max = 0;
+        if (use_values) new_max = newCirc.root.vals.coeff_sum > 0;
+        for (auto const& [key, val] : newCirc.root.poly.poly_map) {
+          if (abs(val) > 0) {
+            new_max = abs(val);
+            break;
+          }
+        }
+        if (new_max == 0) {
+          INSTR_COUNT(PRUNE_ZERO);
+          continue;
+        }
+
+        uint64_t fp = 0;
+        if (use_values) {
+          fp = newCirc.root.vals.fingerprint();
+        } else if (table || n_models > 0) {
+          fp = newCirc.root.poly.fingerprint();
+        }
+        uint64_t key = fp ^ table_salt;
+        TableEntry entry;
+        bool known = table && table->probe(key, entry);
+        // this polynomial was already expanded at most at this cost, so
+        // nothing reachable from here is new
+        if (known && entry.has_cost && newCirc.cost >= entry.cost) {
+          INSTR_COUNT(PRUNE_TABLE);
+          continue;
+        }
+
+        bool is_target;
+        if (known && !entry.hit) {
+          is_target = false;
+        } else if (use_values) {
+          is_target = newCirc.root.vals.same_values(target_vals);
+          if (is_target) {
+            ensure_polys(newCirc);
+            is_target = newCirc.root.poly.poly_map == target.poly_map;
+          }
+        } else {
+          is_target = newCirc.root.poly.poly_map == target.poly_map;
+        }
+
+        if (is_target) {
+          if (!s.soln || newCirc.cost < s.best.cost) {
+            s.soln = true;
+            s.best = newCirc;
+            if (s.models.admits(newCirc.cost, fp)) {
+              s.models.insert(newCirc.cost, fp, make_shared<PrioritizedCircuit>(PrioritizedCircuit{newCirc.cost, newCirc, 0}));
+            }
+          }
+          s.solutions_found += 1;
+          INSTR_COUNT(SOLUTIONS);
+          if (table) {
+            if (!known) table->store(key, 0, true);
+            table->record_cost(key, newCirc.cost);
+          }
+        } else if (!(newCirc.cost >= max_cost || (s.soln && newCirc.cost >= s.best.cost - 1))) {
+          float pred;
+          if (known) {
+            pred = entry.pred;
+          } else {
+            pred = use_values ? approx_pred(newCirc.root.vals, false) : get_pred(newCirc, false);
+            if (table) table->store(key, pred, false);
+          }
+          if (pred < 1000000) {
+            float priority = newCirc.cost + alpha * pred; 
+            if (wrapped) {
+              // restarts are built out of the models, too rough a priority
+              // here fills them with dead ends, so this one is exact. In
+              // value mode the strict approx_pred picks the candidates worth
+              // rebuilding the polynomial of first
+              float strict = use_values ? approx_pred(newCirc.root.vals, true) : get_pred(newCirc, true);
+              priority = newCirc.cost + 1000 * strict;
+              if (use_values && s.models.admits(priority, fp)) {
+                ensure_polys(newCirc);
+                priority = newCirc.cost + 1000 * get_pred(newCirc, true);
+              }
+            }
+            // done before newCirc is copied into circs, so a model that is
+            // moved to keeps its polynomial
+            if (s.models.admits(priority, fp)) {
+              ensure_polys(newCirc);
+              s.models.insert(priority, fp, make_shared<PrioritizedCircuit>(PrioritizedCircuit{priority, newCirc, pred}));
+            }
+
+            circs.push_back(newCirc);
+            preds.push_back(pred);
+            keys.push_back(key);
+            weights.push_back(1.0/pow(newCirc.cost - s.curr.cost + alpha * pred, gamma));
+          } else {
+            INSTR_COUNT(PRUNE_PRED);
+          }
+        } else {
+          INSTR_COUNT(PRUNE_COST);
+        }
+      }
+    }
+    if (circs.size() == 0) {
+      s.curr = blank_circuit(s.models.handles());
+      s.prev_pred = get_pred(s.curr, false);
+      s.restarts += 1;
+      INSTR_COUNT(RESTARTS);
+    } else {
+      discrete_distribution<> d(weights.begin(), weights.end());
+      
+      int choice = d(gen);
+      s.curr = circs[choice];
+      ensure_polys(s.curr);
+      s.prev_pred = preds[choice];
+      if (table) table->record_cost(keys[choice], s.curr.cost);
+    }
+  }
+
+  Circuit sample_search(int max_iters, int max_cost, float alpha, float gamma, bool verbose, bool use_pred, int n_models, bool wrapped) {
+    return sample_search(max_iters, max_cost, alpha, gamma, verbose, use_pred, n_models, wrapped, "", 0);
+  }
+
+  // same as above, but if checkpoint_path is given the run resumes from it
+  // when it exists and saves to it every checkpoint_every iterations
+  Circuit sample_search(int max_iters, int max_cost, float alpha, float gamma, bool verbose, bool use_pred, int n_models, bool wrapped,
+                        const string &checkpoint_path, int checkpoint_every) {
+    SearchState s = start_search(n_models);
+
+    unique_ptr<CheckpointWriter> writer;
+    if (checkpoint_path != "") {
+      string bytes;
+      if (read_file(checkpoint_path, bytes)) {
+        if (load_state(bytes, s, gen, target)) {
+          cout << "resuming from " << checkpoint_path << " at iteration " << s.iteration << endl;
+        } else {
+          cerr << "could not read checkpoint " << checkpoint_path << ", starting fresh" << endl;
+        }
+      }
+      writer = make_unique<CheckpointWriter>(checkpoint_path);
+    }
+
+    for (; s.iteration < max_iters && !(stop_at_first && s.soln); s.iteration++) {
+      int i = s.iteration;
+      if (verbose) {
+        if ((i % 1000) == 0) {
+          cout << "total iters " << s.total_iters << endl;
+          cout << "iteration: " << i + 1 << "/" << max_iters << endl;
+          cout << "best model: ";
+          if (s.models.size() == 0) {
+            cout << "None" << endl;
+          } else {
+            s.models.best()->circuit.root.poly.print();
+          } 
+          if (s.soln) {
+            cout << "solution cost: " << s.best.cost << endl;
+          } else {
+            cout << "solution cost: None" << endl;
+          }
+          
+          cout << "solutions found: " << s.solutions_found << endl;
+          cout << "current cost: " << s.curr.cost << endl;
+          cout << "current prediciton: " << s.prev_pred << endl;
+          s.curr.root.poly.print();
+          cout << endl;
+        }
+      }
+
+      sample_step(s, max_cost, alpha, gamma, use_pred, n_models, wrapped);
+
+      if (writer && checkpoint_every > 0 && (i + 1) % checkpoint_every == 0) {
+        s.iteration += 1; // resume after this iteration, not at it
+        string bytes = save_state(s, gen, target);
+        s.iteration -= 1;
+        writer->submit(bytes);
+      }
+    }
+    if (writer) {
+      string bytes = save_state(s, gen, target);
+      writer->submit(bytes);
+    }
+    last_models = s.models.handles();
+    if (wrapped && !s.soln) {
+      // use -100 to flag this is not a solution
+      return {{}, -100, {}};
+    }
+    return s.best;
+  }
+};
+
+#endif
@@ -7,375 +7,248 @@ Passing large object as parameters with const ref
 
 Switching set to unordered_set didn't often have a noticeable effect, 
 but if it did it usually made the runtime slower
+
+The engine itself lives in stochastic_engine.h, this file just sets up a target
+and picks how to search it
 */
 
-#include "polynomial.h"
-#include <set>
-#include <limits>
-#include <random>
-#include <cmath>
-#include <algorithm>
+#include "stochastic_engine.h"
+#include "tempering.h"
+#include "best_first.h"
+#include "multi_target.h"
+#include "decomposition.h"
+#include "sat_encoder.h"
+#include <cstring>
 using namespace std;
 
-random_device rd; 
-mt19937 gen(rd()); 
-
-int id_counter = 0;
-
-enum Operation {add, mult, var, constant};
-
-const float MULT_COST = 1;
-const float ADD_COST = 0.25;
-
-struct Node {
-  Operation op;
-  int arg;
-  int val;
-  Node* op0;
-  Node* op1;
-  int id;
-  Polynomial poly;
-  set<int> add_set;
-  set<int> mult_set;
-};
-
-struct Circuit {
-  Node root;
-  float cost;
-  vector<Node> nodes;
-};
-
-struct PrioritizedCircuit {
-  float priority;
-  Circuit circuit;
-  float dist;
-};
-
-struct pc_less {
-  bool operator () (PrioritizedCircuit const& a, PrioritizedCircuit const& b) const {
-    if (a.priority < b.priority) return true;
-    if (a.priority > b.priority) return false;
-
-    return false;
-  }
-};
-
-Node get_leaf(int n_var, int arg, int val) {
-  Polynomial poly = Polynomial(n_var);
-  vector<int> powers(n_var, 0); // initialize vector to all 0
-
-  Operation op;
-  if (arg != -1) {
-    powers[arg] = 1;
-    poly.poly_map[powers] = 1;
-    op = var;
+void print_solution(Polynomial &target, const Circuit &sol) {
+  cout << "Target: ";
+  target.print();
+  if (sol.cost == -100) {
+    cout << "NO SOLUTION" << endl;
   } else {
-    poly.poly_map[powers] = val;
-    op = constant;
+    cout << "Solution: ";
+    Polynomial found = sol.root.poly;
+    found.print();
+    cout << "Additions: " << sol.root.add_set.size() << endl;
+    cout << "Multiplications: " << sol.root.mult_set.size() << endl;
   }
-
-  id_counter += 1;
-  Node leaf = {op, arg, val, nullptr, nullptr, id_counter, poly, {}, {}};
-  return leaf;
 }
 
-class Stochastic {
-  public:
-  Polynomial target;
-  int n_var;
-  vector<Node> leaves;
-  int max_val;
-
-  Stochastic(const Polynomial &poly, int n_vals) {
-    target = poly;
-    n_var = poly.n_var;
-
-    for (int i = 0; i < n_var; i++) {
-      leaves.push_back(get_leaf(n_var, i, 0));
-    }
-    for (int i = 1; i < n_vals + 1; i++) {
-      leaves.push_back(get_leaf(n_var, -1, i));
+int main(int argc, char **argv) {
+  // --replicas N runs N tempered copies of the sampler instead of just one
+  // --table BITS shares a transposition table of 2^BITS slots
+  // --checkpoint PATH saves the sampler every 1000 iterations and resumes from
+  // PATH if it already exists. Only the single sampler can be checkpointed
+  // --library PATH seeds restarts with circuits from a subcircuit library and
+  // merges what this run found back into it
+  // --astar runs the deterministic best-first search instead of sampling,
+  // --beam W makes it a beam search of width W
+  // --target POLY searches POLY (written like Polynomial::print output)
+  // instead of a + b + c. Given more than once, all targets are searched
+  // together over a shared node pool
+  // --decompose splits the target into factors and variable disjoint parts,
+  // searches those and reports the recombined circuit
+  // --values has the sampler work on value vectors instead of polynomials
+  // --sat SOLVER finds the cheapest circuit (up to 6 gates) with a SAT
+  // solver such as inclusion_exclusion/matthew_chaff/fast.c, proving on the
+  // way that nothing cheaper exists. --sat-gates N allows up to N gates
+  // --seed N seeds the search instead of random_device, --first stops the
+  // sampler at its first solution. benchmark.cpp uses both
+  vector<string> target_texts = {};
+  string sat_solver = "";
+  int sat_gates = 6;
+  bool seeded = false;
+  unsigned seed = 0;
+  bool first = false;
+  bool decompose = false;
+  bool values = false;
+  int n_replicas = 0;
+  string library_path = "";
+  bool astar = false;
+  int beam_width = 0;
+  int table_bits = 0;
+  string checkpoint_path = "";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--replicas") && i + 1 < argc) {
+      n_replicas = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--table") && i + 1 < argc) {
+      table_bits = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+      checkpoint_path = argv[++i];
+    } else if (!strcmp(argv[i], "--library") && i + 1 < argc) {
+      library_path = argv[++i];
+    } else if (!strcmp(argv[i], "--astar")) {
+      astar = true;
+    } else if (!strcmp(argv[i], "--beam") && i + 1 < argc) {
+      astar = true;
+      beam_width = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--target") && i + 1 < argc) {
+      target_texts.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "--decompose")) {
+      decompose = true;
+    } else if (!strcmp(argv[i], "--sat") && i + 1 < argc) {
+      sat_solver = argv[++i];
+    } else if (!strcmp(argv[i], "--sat-gates") && i + 1 < argc) {
+      sat_gates = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seeded = true;
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--first")) {
+      first = true;
+    } else if (!strcmp(argv[i], "--values")) {
+      values = true;
     }
   }
 
-  Circuit blank_circuit(const vector<Circuit> &models) {
-    set<int> seen_ids = {};
-    vector<Node> nodes = {};
-    for (int i = 0; i < leaves.size(); i++) {
-      nodes.push_back(leaves[i]);
-      seen_ids.insert(leaves[i].id);
-    }
-
-    for (int i = 0; i < models.size(); i++) {
-      for (int j = 0; j < models[i].nodes.size(); j++) {
-        int curr_id = models[i].nodes[j].id;
-        if ((!seen_ids.count(curr_id)) &&  (models[i].root.add_set.count(curr_id) || models[i].root.mult_set.count(curr_id))) {
-          seen_ids.insert(curr_id);
-          nodes.push_back(models[i].nodes[j]);
-        }
-      }
-    }
-
-    uniform_int_distribution<> distr(0, nodes.size() - 1);
-    Circuit newCirc = {nodes[distr(gen)], 0, nodes};
-    return newCirc;
+  if (checkpoint_path != "" && (n_replicas > 0 || astar || target_texts.size() > 1 || decompose || sat_solver != "")) {
+    cerr << "--checkpoint only works with the plain sampler" << endl;
+    return 1;
   }
 
-  float get_pred(const Circuit &circuit, bool simple) {
-    Polynomial r = circuit.root.poly;
-
-    int curr_max = 0;
-    set<vector<int>> s_a = {};
-    for (auto const& [key, val] : r.poly_map) {
-      if (val > curr_max) {
-        curr_max = val;
-      }
-      s_a.insert(key);
-    }
-    if ((r.poly_map.size() > target.poly_map.size()) || (curr_max > max_val)) {
-      return 1000000;
+  vector<Polynomial> targets = {};
+  int n_var = 0;
+  for (auto &text : target_texts) {
+    n_var = max(n_var, poly_n_var(text));
+  }
+  for (auto &text : target_texts) {
+    Polynomial target;
+    if (!parse_poly(text, n_var, target)) {
+      cerr << "could not parse target " << text << endl;
+      return 1;
     }
+    targets.push_back(target);
+  }
 
-    Polynomial q = target - r;
-    float d_plus = 0;
-    for (auto const& [key, val] : q.poly_map) {
-      if (val == 0) continue;
-      if (simple && val < 0) {
-        return 1000000;
-      }
-      else {
-        d_plus += sqrt(abs(val));
+  if (targets.size() > 1) {
+    MultiTarget batch = seeded ? MultiTarget(targets, 8, table_bits, 64, seed) : MultiTarget(targets, 8, table_bits, 64);
+    if (library_path != "") {
+      SubcircuitLibrary library;
+      library.open(library_path);
+      for (size_t i = 0; i < library.size(); i++) {
+        batch.add_to_pool({library.item(i)});
       }
     }
+    vector<Circuit> sols = batch.search(100, 100, 10, 1, 1, false, 3);
 
-    set<vector<int>> s_p = {};
-    for (auto const& [key, val] : target.poly_map) {
-      s_p.insert(key);
-    }
-    
-    set<vector<int>> unique1;
-    set_difference(s_a.begin(), s_a.end(), s_p.begin(), s_p.end(),
-      inserter(unique1, unique1.end()));
-    set<vector<int>> unique2;
-    set_difference(s_p.begin(), s_p.end(), s_a.begin(), s_a.end(),
-      inserter(unique2, unique2.end()));
-
-    // getting all the terms that are unique to target and r
-    set<vector<int>> unique;
-    set_union(unique1.begin(), unique1.end(), unique2.begin(), unique2.end(),
-      inserter(unique, unique.end()));
-
-    vector<int> temp_sums = {};
-    for (const auto& vec : unique) {
-      int sum = 0;
-      for (const auto& elem : vec) {
-        sum += elem;
-      }
-      temp_sums.push_back(sum);
+    vector<LibraryItem> found = {};
+    for (int t = 0; t < targets.size(); t++) {
+      print_solution(targets[t], sols[t]);
+      vector<LibraryItem> more = batch.engines[t].discoveries(sols[t]);
+      found.insert(found.end(), more.begin(), more.end());
     }
-    float d_x = 0;
-    for (const auto& elem : temp_sums) {
-      d_x += elem;
+    if (library_path != "" && !SubcircuitLibrary::merge(library_path, found)) {
+      cerr << "could not update subcircuit library " << library_path << endl;
     }
-
-    float cost = d_plus + d_x;
-    return cost;
+    return 0;
   }
 
-  Circuit create_new(Circuit circuit, const Operation &op, Node* op0, Node* op1, bool track_sets) {
-    id_counter += 1;
-    int id = id_counter;
+  Polynomial poly;
+  if (targets.size() == 1) {
+    poly = targets[0];
+  } else {
+    poly = Polynomial(3);
+    poly.new_term({1, 0, 0}, 1);
+    poly.new_term({0, 1, 0}, 1);
+    poly.new_term({0, 0, 1}, 1);
+  }
+  poly.print();
 
-    set<int> add_set;
-    set<int> mult_set;
-    
-    if (track_sets) {
-      set_union(op0->add_set.begin(), op0->add_set.end(), op1->add_set.begin(), op1->add_set.end(),
-        inserter(add_set, add_set.end()));
-      set_union(op0->mult_set.begin(), op0->mult_set.end(), op1->mult_set.begin(), op1->mult_set.end(),
-        inserter(mult_set, mult_set.end()));
+  if (decompose) {
+    Decomposer decomposer = Decomposer(8);
+    Piece root = decomposer.decompose(poly);
+    cout << "Decomposition: " << decomposer.describe(root) << endl;
 
-      if (op == add) {
-        add_set.insert(id);
-      } else {
-        mult_set.insert(id);
-      }
+    LibraryItem combined;
+    if (!decomposer.solve(root, 8, 10000, 10, 3, combined)) {
+      cout << "NO SOLUTION" << endl;
+      return 0;
     }
-
-    Polynomial newPoly;
-    if (op == add) {
-      newPoly = op0->poly + op1->poly;
-    } else {
-      newPoly = op0->poly * op1->poly;
+    Polynomial check = gates_poly(combined.gates, poly.n_var);
+    int adds = 0, mults = 0;
+    for (auto &gate : combined.gates) {
+      if (gate.op == add) adds++;
+      if (gate.op == mult) mults++;
     }
-
-    Node newNode = {op, -1, 0, op0, op1, id_counter, newPoly, add_set, mult_set};
-
-    float cost = 0;
-    if (op == mult) {
-      cost = circuit.cost + MULT_COST;
-    } else {
-      cost = circuit.cost + ADD_COST;
+    cout << "Target: ";
+    poly.print();
+    cout << "Solution: ";
+    check.print();
+    cout << "Additions: " << adds << endl;
+    cout << "Multiplications: " << mults << endl;
+    if (drop_zeros(check).poly_map != drop_zeros(poly).poly_map) {
+      cerr << "recombined circuit doesn't compute the target" << endl;
+      return 1;
     }
-    if (track_sets) {
-      cost = ADD_COST * newNode.add_set.size() + MULT_COST * newNode.mult_set.size();
+    if (library_path != "" && !SubcircuitLibrary::merge(library_path, {combined})) {
+      cerr << "could not update subcircuit library " << library_path << endl;
     }
-    
-    circuit.nodes.push_back(newNode);
-    Circuit newC = {newNode, cost, circuit.nodes};
-
-    return newC;
+    return 0;
   }
 
-  Circuit sample_search(int max_iters, int max_cost, float alpha, float gamma, bool verbose, bool use_pred, int n_models, bool wrapped) {
-    Circuit best;
-    bool soln = false;
-    
-    int solutions_found = 0;
-
-    Circuit curr = blank_circuit({});
-    
-    float prev_pred = get_pred(curr, false);
-    vector<PrioritizedCircuit> models;
-
-    int total_iters = 0;
-
-    for (int i = 0; i < max_iters; i++) {
-      if (verbose) {
-        if ((i % 1000) == 0) {
-          cout << "total iters " << total_iters << endl;
-          cout << "iteration: " << i + 1 << "/" << max_iters << endl;
-          cout << "best model: ";
-          if (models.size() == 0) {
-            cout << "None" << endl;
-          } else {
-            models[0].circuit.root.poly.print();
-          } 
-          if (soln) {
-            cout << "solution cost: " << best.cost << endl;
-          } else {
-            cout << "solution cost: None" << endl;
-          }
-          
-          cout << "solutions found: " << solutions_found << endl;
-          cout << "current cost: " << curr.cost << endl;
-          cout << "current prediciton: " << prev_pred << endl;
-          curr.root.poly.print();
-          cout << endl;
-        }
-      }
-
-      vector<Circuit> circs = {};
-      vector<float> preds = {};
-      vector<float> weights = {};
-      vector<PrioritizedCircuit> potential_models = {};
-
-      for (int n = 0; n < curr.nodes.size(); n++) {
-        for (auto const& oper : {add, mult}) {
-          total_iters += 1;
-          Circuit newCirc = create_new(curr, oper, &curr.root, &curr.nodes[n], n_models > 0);
-
-          int new_max = 0;
-          for (auto const& [key, val] : newCirc.root.poly.poly_map) {
-            if (abs(val) > 0) {
-              new_max = abs(val);
-              break;
-            }
-          }
-          if (new_max == 0) continue;
-
-          if (newCirc.root.poly.poly_map == target.poly_map) {
-            if (!soln || newCirc.cost < best.cost) {
-              soln = true;
-              best = newCirc;
-              if (n_models > 0) {
-                PrioritizedCircuit pc = {newCirc.cost, newCirc, 0};
-                potential_models.push_back(pc);
-              }
-            }
-            solutions_found += 1;
-          } else if (!(newCirc.cost >= max_cost || (soln && newCirc.cost >= best.cost - 1))) {
-            float pred = get_pred(newCirc, false);
-            if (pred < 1000000) {
-              circs.push_back(newCirc);
-              preds.push_back(pred);
-              weights.push_back(1.0/pow(newCirc.cost - curr.cost + alpha * pred, gamma));
-
-              float priority = newCirc.cost + alpha * pred; 
-              if (wrapped) {
-                priority = newCirc.cost + 1000 * get_pred(newCirc, true);
-              }
-              if (n_models > 0 && (models.size() < n_models || priority < models.back().priority)) {
-                PrioritizedCircuit pc = {priority, newCirc, pred};
-                potential_models.push_back(pc);
-              }
-            }
-          }
-        }
-      }
-      if (potential_models.size() > 0 && n_models > 0) {
-        models.insert(models.end(), potential_models.begin(), potential_models.end());
-        vector<PrioritizedCircuit> new_models = models;
-        sort(new_models.begin(), new_models.end(), pc_less());
-        models = {};
-
-        set<float> seen_pri;
-        int min_val;
-        if (n_models < new_models.size()) {
-          min_val = n_models;
-        } else {
-          min_val = new_models.size();
-        }
-        for (int k = 0; k < min_val; k++) {
-          if (!seen_pri.count(new_models[k].priority)) {
-            seen_pri.insert(new_models[k].priority);
-            models.push_back(new_models[k]);
-          }
-        }
-      }
-      if (circs.size() == 0) {
-        vector<Circuit> modelCircuits = {};
-        for (int k = 0; k < models.size(); k++) {
-          modelCircuits.push_back(models[k].circuit);
-        }
-        curr = blank_circuit(modelCircuits);
-      } else {
-        discrete_distribution<> d(weights.begin(), weights.end());
-        
-        int choice = d(gen);
-        curr = circs[choice];
-        prev_pred = preds[choice];
-      }
-
-    }
-    if (wrapped && !soln) {
-      // use -100 to flag this is not a solution
-      return {{}, -100, {}};
-    }
-    return best;
+  if (sat_solver != "") {
+    vector<LibraryGate> gates;
+    float cost;
+    if (!sat_search(poly, 8, sat_gates, sat_solver, seeded ? seed : random_device()(), true, gates, cost)) {
+      cerr << "no circuit with up to " << sat_gates << " gates, --sat-gates raises the limit" << endl;
+      cout << "NO SOLUTION" << endl;
+      return 0;
+    }
+    int adds = 0, mults = 0;
+    for (auto &gate : gates) {
+      if (gate.op == add) adds++;
+      if (gate.op == mult) mults++;
+    }
+    cout << "Target: ";
+    poly.print();
+    cout << "Solution: ";
+    gates_poly(gates, poly.n_var).print();
+    cout << "Additions: " << adds << endl;
+    cout << "Multiplications: " << mults << endl;
+    return 0;
   }
-};
 
-int main() {
-  Polynomial poly = Polynomial(3);
-  poly.new_term({1, 0, 0}, 1);
-  poly.new_term({0, 1, 0}, 1);
-  poly.new_term({0, 0, 1}, 1);
-  poly.print();
-
-  Stochastic engine = Stochastic(poly, 8);
-  Circuit sol = engine.sample_search(10000, 10, 1, 1, false, true, 3, true);
+  string saved;
+  if (checkpoint_path != "" && read_file(checkpoint_path, saved) && !checkpoint_matches(saved, poly)) {
+    // resuming would search the wrong target and saving would overwrite it
+    cerr << "checkpoint " << checkpoint_path << " was not written for this target by this version, not resuming it" << endl;
+    return 1;
+  }
 
-  cout << "Target: ";
-  poly.print();
-  if (sol.cost == -100) {
-    cout << "NO SOLUTION" << endl;
+  Stochastic engine = seeded ? Stochastic(poly, 8, seed) : Stochastic(poly, 8);
+  engine.stop_at_first = first;
+  // best-first search needs exact preds for its ordering
+  engine.use_values = values && !astar;
+  if (table_bits > 0) {
+    engine.table = make_shared<TranspositionTable>(table_bits);
+  }
+  if (library_path != "") {
+    SubcircuitLibrary library;
+    library.open(library_path);
+    engine.seed_from_library(library, 64);
+    cout << "seeded " << engine.library_nodes.size() << " nodes from " << library.size() << " library circuits" << endl;
+  }
+  Circuit sol;
+  vector<LibraryItem> found = {};
+  if (astar) {
+    BestFirst search = BestFirst(engine);
+    sol = search.search(100000, 10, 1, beam_width, 1000000, false);
+    if (library_path != "") found = engine.discoveries(sol);
+  } else if (n_replicas > 0) {
+    ReplicaExchange tempering = ReplicaExchange(engine, n_replicas, 8);
+    sol = tempering.search(100, 100, 10, 10, 1, 1, false, true, 3, true);
+    if (library_path != "") found = tempering.discoveries(sol);
   } else {
-    cout << "Solution: ";
-    sol.root.poly.print();
-    cout << "Additions: " << sol.root.add_set.size() << endl;
-    cout << "Multiplications: " << sol.root.mult_set.size() << endl;
+    sol = engine.sample_search(10000, 10, 1, 1, false, true, 3, true, checkpoint_path, 1000);
+    if (library_path != "") found = engine.discoveries(sol);
+  }
+
+  if (library_path != "") {
+    if (!SubcircuitLibrary::merge(library_path, found)) {
+      cerr << "could not update subcircuit library " << library_path << endl;
+    }
   }
 
+  print_solution(poly, sol);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,288 @@
+#ifndef SUBCIRCUIT_LIBRARY_H
+#define SUBCIRCUIT_LIBRARY_H
+
+#include "circuit.h"
+#include <map>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+/*
+Persistent library of cheap circuits, shared across searches and targets.
+
+The file is laid out so it can be memory mapped and checked once, without
+parsing; item(i) then copies one record's circuit out of the mapping:
+  LibraryHeader
+  LibraryRecord[n_records]   sorted by fingerprint, as merge() writes them
+  LibraryGate[n_gates]       every record's gates, back to back
+
+A record's gates form a straight line program: var and constant gates are
+leaves, add and mult gates name two earlier gates of the same record. Storing
+gates instead of node ids keeps entries valid across runs, where ids differ.
+
+A search seeds its node pool from the records that could still be part of a
+circuit for its target (see Stochastic::seed_from_library) and merges the
+subcircuits of its solution and models back in when it is done. merge() keeps
+the cheaper circuit when a polynomial is already there, and holds an flock on
+path.lock while it reads and rewrites the file, so searches finishing at the
+same time don't drop each other's circuits.
+*/
+
+const uint32_t LIBRARY_VERSION = 1;
+
+struct LibraryHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t n_records;
+  uint64_t n_gates;
+};
+
+struct LibraryRecord {
+  uint64_t fingerprint;
+  float cost;
+  int32_t n_var;
+  uint64_t first_gate;
+  uint32_t n_gates;
+  uint32_t pad;
+};
+
+struct LibraryGate {
+  uint8_t op;
+  uint8_t pad[3];
+  int32_t a; // first operand, or the variable / constant for leaves
+  int32_t b; // second operand
+};
+
+static_assert(sizeof(LibraryHeader) == 24, "library header layout");
+static_assert(sizeof(LibraryRecord) == 32, "library record layout");
+static_assert(sizeof(LibraryGate) == 12, "library gate layout");
+
+struct LibraryItem {
+  uint64_t fingerprint;
+  float cost;
+  int n_var;
+  vector<LibraryGate> gates;
+};
+
+// gates for the subcircuit rooted at node, looking operands up by id.
+// Returns false if some operand isn't in by_id
+bool node_to_gates(const Node &node, const unordered_map<int, const Node*> &by_id,
+                   vector<LibraryGate> &gates, unordered_map<int, int> &gate_of, float &cost) {
+  if (gate_of.count(node.id)) return true;
+
+  LibraryGate gate = {};
+  gate.op = node.op;
+  if (node.op == var) {
+    gate.a = node.arg;
+  } else if (node.op == constant) {
+    gate.a = node.val;
+  } else {
+    auto op0 = by_id.find(node.op0_id);
+    auto op1 = by_id.find(node.op1_id);
+    if (op0 == by_id.end() || op1 == by_id.end()) return false;
+    if (!node_to_gates(*op0->second, by_id, gates, gate_of, cost)) return false;
+    if (!node_to_gates(*op1->second, by_id, gates, gate_of, cost)) return false;
+    gate.a = gate_of[node.op0_id];
+    gate.b = gate_of[node.op1_id];
+    cost += node.op == add ? ADD_COST : MULT_COST;
+  }
+  gate_of[node.id] = gates.size();
+  gates.push_back(gate);
+  return true;
+}
+
+// one library item per non-leaf node of circuit, each with its own gates
+vector<LibraryItem> circuit_items(const Circuit &circuit) {
+  unordered_map<int, const Node*> by_id = {};
+  for (auto &node : circuit.nodes) {
+    by_id[node.id] = &node;
+  }
+  by_id[circuit.root.id] = &circuit.root;
+
+  vector<LibraryItem> items = {};
+  for (auto const& [id, node] : by_id) {
+    if (node->op == var || node->op == constant) continue;
+    LibraryItem item = {node->poly.fingerprint(), 0, node->poly.n_var, {}};
+    unordered_map<int, int> gate_of = {};
+    if (node_to_gates(*node, by_id, item.gates, gate_of, item.cost)) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+// the polynomial a gate list computes, i.e. that of its last gate
+Polynomial gates_poly(const vector<LibraryGate> &gates, int n_var) {
+  vector<Polynomial> values = {};
+  for (auto &gate : gates) {
+    Polynomial value = Polynomial(n_var);
+    vector<int> powers(n_var, 0);
+    if (gate.op == var) {
+      powers[gate.a] = 1;
+      value.poly_map[powers] = 1;
+    } else if (gate.op == constant) {
+      value.poly_map[powers] = gate.a;
+    } else if (gate.op == add) {
+      value = values[gate.a] + values[gate.b];
+    } else {
+      value = values[gate.a] * values[gate.b];
+    }
+    values.push_back(value);
+  }
+  if (values.empty()) return Polynomial(n_var);
+  return values.back();
+}
+
+class SubcircuitLibrary {
+  public:
+  const char *base;
+  size_t length;
+  const LibraryHeader *header;
+  const LibraryRecord *records;
+  const LibraryGate *gates;
+
+  SubcircuitLibrary() {
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+    records = nullptr;
+    gates = nullptr;
+  }
+
+  ~SubcircuitLibrary() {
+    close();
+  }
+
+  SubcircuitLibrary(const SubcircuitLibrary&) = delete;
+  SubcircuitLibrary& operator = (const SubcircuitLibrary&) = delete;
+
+  // maps path read only. A missing file is just an empty library
+  bool open(const string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(LibraryHeader)) {
+      ::close(fd);
+      return false;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    base = (const char*) mapped;
+    length = st.st_size;
+    header = (const LibraryHeader*) base;
+    records = (const LibraryRecord*) (base + sizeof(LibraryHeader));
+    gates = (const LibraryGate*) (records + header->n_records);
+
+    // the counts are checked against the length before multiplying them out
+    bool ok = memcmp(header->magic, "ACLB", 4) == 0 && header->version == LIBRARY_VERSION &&
+              header->n_records <= length / sizeof(LibraryRecord) && header->n_gates <= length / sizeof(LibraryGate) &&
+              sizeof(LibraryHeader) + header->n_records * sizeof(LibraryRecord) + header->n_gates * sizeof(LibraryGate) == length;
+    for (size_t i = 0; ok && i < header->n_records; i++) {
+      ok = valid_record(records[i]);
+    }
+    if (!ok) {
+      cerr << "ignoring malformed subcircuit library " << path << endl;
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // whether r's gates are inside the file and form a straight line program,
+  // so item() and whatever rebuilds its gates can trust them
+  bool valid_record(const LibraryRecord &r) const {
+    if (r.n_var < 0 || r.first_gate > header->n_gates || r.n_gates > header->n_gates - r.first_gate) return false;
+    for (uint32_t g = 0; g < r.n_gates; g++) {
+      const LibraryGate &gate = gates[r.first_gate + g];
+      if (gate.op == var) {
+        if (gate.a < 0 || gate.a >= r.n_var) return false;
+      } else if (gate.op == add || gate.op == mult) {
+        if (gate.a < 0 || gate.b < 0 || (uint32_t) gate.a >= g || (uint32_t) gate.b >= g) return false;
+      } else if (gate.op != constant) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void close() {
+    if (base) munmap((void*) base, length);
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+    records = nullptr;
+    gates = nullptr;
+  }
+
+  size_t size() const {
+    return header ? header->n_records : 0;
+  }
+
+  LibraryItem item(size_t i) const {
+    const LibraryRecord &r = records[i];
+    LibraryItem it = {r.fingerprint, r.cost, r.n_var, {}};
+    it.gates.assign(gates + r.first_gate, gates + r.first_gate + r.n_gates);
+    return it;
+  }
+
+  // adds items to the library at path, keeping the cheaper circuit per
+  // polynomial, and rewrites it through path.tmp. The lock is on a file of
+  // its own since the rename replaces path
+  static bool merge(const string &path, const vector<LibraryItem> &items) {
+    int lock_fd = ::open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) return false;
+    bool ok = flock(lock_fd, LOCK_EX) == 0 && rewrite(path, items);
+    ::close(lock_fd);
+    return ok;
+  }
+
+  private:
+  static bool rewrite(const string &path, const vector<LibraryItem> &items) {
+    map<uint64_t, LibraryItem> merged = {};
+    {
+      SubcircuitLibrary existing;
+      existing.open(path);
+      for (size_t i = 0; i < existing.size(); i++) {
+        merged[existing.records[i].fingerprint] = existing.item(i);
+      }
+    }
+    for (auto &it : items) {
+      auto found = merged.find(it.fingerprint);
+      if (found == merged.end() || it.cost < found->second.cost) {
+        merged[it.fingerprint] = it;
+      }
+    }
+
+    LibraryHeader header = {{'A', 'C', 'L', 'B'}, LIBRARY_VERSION, merged.size(), 0};
+    vector<LibraryRecord> records = {};
+    for (auto const& [fp, it] : merged) {
+      records.push_back({fp, it.cost, it.n_var, header.n_gates, (uint32_t) it.gates.size(), 0});
+      header.n_gates += it.gates.size();
+    }
+
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (!records.empty()) {
+      ok = ok && fwrite(records.data(), sizeof(LibraryRecord), records.size(), f) == records.size();
+    }
+    for (auto const& [fp, it] : merged) {
+      if (it.gates.empty()) continue;
+      ok = ok && fwrite(it.gates.data(), sizeof(LibraryGate), it.gates.size(), f) == it.gates.size();
+    }
+    ok = (fclose(f) == 0) && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+  }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef TEMPERING_H
+#define TEMPERING_H
+
+#include "stochastic_engine.h"
+#include <thread>
+using namespace std;
+
+/*
+Replica exchange (parallel tempering) on top of Stochastic::sample_step.
+
+Each replica is a copy of the engine sampling at its own temperature T, which
+divides gamma in the candidate weights 1/pow(delta + alpha*pred, gamma/T). The
+coldest replica (T = 1) is the plain sampler, hotter replicas walk closer to
+uniformly. Every swap_interval steps, neighbouring replicas try to trade their
+current circuits with the usual Metropolis rule on E = cost + alpha*pred, so
+good states found by hot replicas sink down instead of the cold replica having
+to restart from blank_circuit.
+
+The spacing between temperatures is adapted every adapt_interval rounds so
+that each neighbouring pair swaps at roughly target_accept.
+*/
+
+const float TARGET_ACCEPT = 0.23;
+
+class ReplicaExchange {
+  public:
+  vector<Stochastic> engines;
+  vector<SearchState> states;
+  vector<float> temps;
+  vector<int> swap_attempts;
+  vector<int> swap_accepts;
+  mt19937 gen;
+
+  ReplicaExchange(const Stochastic &engine, int n_replicas, float max_temp) {
+    // replica seeds come from the engine's generator, so a seeded engine
+    // gives a reproducible run
+    mt19937 seeds = engine.gen;
+    gen.seed(seeds());
+
+    for (int r = 0; r < n_replicas; r++) {
+      engines.push_back(engine);
+      engines[r].gen.seed(seeds());
+
+      // start geometrically spaced between 1 and max_temp
+      if (n_replicas == 1) {
+        temps.push_back(1);
+      } else {
+        temps.push_back(pow(max_temp, (float) r / (n_replicas - 1)));
+      }
+    }
+    swap_attempts = vector<int>(max(n_replicas - 1, 0), 0);
+    swap_accepts = vector<int>(max(n_replicas - 1, 0), 0);
+  }
+
+  float energy(const SearchState &s, float alpha) {
+    return s.curr.cost + alpha * s.prev_pred;
+  }
+
+  // try to swap the current circuits of replicas r and r + 1
+  void try_swap(int r, float alpha) {
+    float delta = (1.0 / temps[r] - 1.0 / temps[r + 1]) * (energy(states[r], alpha) - energy(states[r + 1], alpha));
+    swap_attempts[r] += 1;
+
+    uniform_real_distribution<> unif(0, 1);
+    if (delta >= 0 || unif(gen) < exp(delta)) {
+      swap(states[r].curr, states[r + 1].curr);
+      swap(states[r].prev_pred, states[r + 1].prev_pred);
+      swap_accepts[r] += 1;
+    }
+  }
+
+  // widen gaps that swap too often and shrink the ones that rarely do,
+  // keeping the coldest replica pinned at T = 1
+  void adapt_temps() {
+    vector<float> log_gaps = {};
+    for (int r = 0; r + 1 < temps.size(); r++) {
+      float rate = 0;
+      if (swap_attempts[r] > 0) {
+        rate = (float) swap_accepts[r] / swap_attempts[r];
+      }
+      float gap = log(temps[r + 1] / temps[r]) * exp(rate - TARGET_ACCEPT);
+      log_gaps.push_back(max(gap, 0.01f));
+      swap_attempts[r] = 0;
+      swap_accepts[r] = 0;
+    }
+    for (int r = 0; r + 1 < temps.size(); r++) {
+      temps[r + 1] = temps[r] * exp(log_gaps[r]);
+    }
+  }
+
+  // share the cheapest solution so every replica prunes against it
+  void share_best() {
+    int best_r = -1;
+    for (int r = 0; r < states.size(); r++) {
+      if (states[r].soln && (best_r == -1 || states[r].best.cost < states[best_r].best.cost)) {
+        best_r = r;
+      }
+    }
+    if (best_r == -1) return;
+    for (int r = 0; r < states.size(); r++) {
+      if (!states[r].soln || states[r].best.cost > states[best_r].best.cost) {
+        states[r].soln = true;
+        states[r].best = states[best_r].best;
+      }
+    }
+  }
+
+  Circuit search(int max_rounds, int swap_interval, int adapt_interval, int max_cost, float alpha, float gamma, bool verbose, bool use_pred, int n_models, bool wrapped) {
+    states = {};
+    for (int r = 0; r < engines.size(); r++) {
+      states.push_back(engines[r].start_search(n_models));
+    }
+
+    for (int round = 0; round < max_rounds; round++) {
+      vector<thread> workers = {};
+      for (int r = 0; r < engines.size(); r++) {
+        workers.push_back(thread([&, r]() {
+          for (int i = 0; i < swap_interval; i++) {
+            engines[r].sample_step(states[r], max_cost, alpha, gamma / temps[r], use_pred, n_models, wrapped);
+          }
+        }));
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+
+      // alternate between even and odd pairs so every pair gets a turn
+      for (int r = round % 2; r + 1 < engines.size(); r += 2) {
+        try_swap(r, alpha);
+      }
+      share_best();
+
+      if (adapt_interval > 0 && (round + 1) % adapt_interval == 0) {
+        adapt_temps();
+      }
+
+      if (verbose && (round % 10) == 0) {
+        cout << "round: " << round + 1 << "/" << max_rounds << endl;
+        for (int r = 0; r < engines.size(); r++) {
+          cout << "replica " << r << " T = " << temps[r] << " E = " << energy(states[r], alpha)
+               << " restarts = " << states[r].restarts << endl;
+        }
+        if (states[0].soln) {
+          cout << "solution cost: " << states[0].best.cost << endl;
+        } else {
+          cout << "solution cost: None" << endl;
+        }
+        cout << endl;
+      }
+    }
+
+    share_best();
+    // discoveries() reads these, the engine the replicas were copied from
+    // never ran
+    for (int r = 0; r < engines.size(); r++) {
+      engines[r].last_models = states[r].models.handles();
+    }
+    if (!states[0].soln) {
+      if (wrapped) {
+        // use -100 to flag this is not a solution
+        return {{}, -100, {}};
+      }
+      return {};
+    }
+    return states[0].best;
+  }
+
+  // every subcircuit of sol and of every replica's models pool, for merging
+  // into a library
+  vector<LibraryItem> discoveries(const Circuit &sol) {
+    vector<LibraryItem> items = {};
+    for (int r = 0; r < engines.size(); r++) {
+      vector<LibraryItem> more = engines[r].discoveries(r == 0 ? sol : Circuit{{}, -100, {}});
+      items.insert(items.end(), more.begin(), more.end());
+    }
+    return items;
+  }
+};
+
+#endif
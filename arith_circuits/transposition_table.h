@@ -0,0 +1,112 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+/*
+Fixed size, lock-free cache of what the sampler already knows about a
+polynomial, keyed by Polynomial::fingerprint():
+  - the get_pred value, so revisits don't recompute it
+  - whether the polynomial is the target, so revisits skip the equality check
+  - the cheapest cost at which a circuit reaching it has been expanded, so a
+    candidate reaching it again at equal or higher cost can be pruned
+
+Each slot is two 64 bit words, the packed data and key ^ data (the usual
+lockless hashing trick), so a slot torn by a concurrent write just reads back
+as a miss. Slots are direct mapped and a new key always replaces the old one.
+*/
+
+const uint16_t NO_COST = 0xFFFF;
+
+struct TableEntry {
+  float pred;
+  float cost; // only meaningful if has_cost
+  bool has_cost;
+  bool hit;
+};
+
+class TranspositionTable {
+  public:
+  struct Slot {
+    atomic<uint64_t> check;
+    atomic<uint64_t> data;
+  };
+
+  uint64_t mask;
+  vector<Slot> slots;
+
+  TranspositionTable(int bits) : slots((size_t) 1 << bits) {
+    mask = ((uint64_t) 1 << bits) - 1;
+    for (auto &slot : slots) {
+      slot.check.store(0, memory_order_relaxed);
+      slot.data.store(0, memory_order_relaxed);
+    }
+  }
+
+  bool probe(uint64_t key, TableEntry &entry) {
+    Slot &slot = slots[key & mask];
+    uint64_t data = slot.data.load(memory_order_relaxed);
+    uint64_t check = slot.check.load(memory_order_relaxed);
+    if ((check ^ data) != key || data == 0) return false;
+    entry = unpack(data);
+    return true;
+  }
+
+  // store pred and hit for key, keeping the cost if key was already there
+  void store(uint64_t key, float pred, bool hit) {
+    TableEntry entry = {pred, 0, false, hit};
+    TableEntry old;
+    if (probe(key, old)) {
+      entry.cost = old.cost;
+      entry.has_cost = old.has_cost;
+    }
+    write(key, entry);
+  }
+
+  // record that a circuit reaching key was expanded at this cost
+  void record_cost(uint64_t key, float cost) {
+    TableEntry entry;
+    if (!probe(key, entry)) return;
+    if (entry.has_cost && entry.cost <= cost) return;
+    entry.cost = cost;
+    entry.has_cost = true;
+    write(key, entry);
+  }
+
+  private:
+  // costs are multiples of ADD_COST, so quarter units fit in 16 bits
+  static uint64_t pack(const TableEntry &entry) {
+    uint32_t pred_bits;
+    memcpy(&pred_bits, &entry.pred, sizeof(pred_bits));
+    uint64_t cost_bits = NO_COST;
+    if (entry.has_cost && entry.cost * 4 < NO_COST) {
+      cost_bits = (uint64_t) (entry.cost * 4 + 0.5);
+    }
+    // bit 48 is always set so that a used slot is never all zeros
+    return (uint64_t) pred_bits | (cost_bits << 32) | ((uint64_t) 1 << 48) | ((uint64_t) entry.hit << 49);
+  }
+
+  static TableEntry unpack(uint64_t data) {
+    TableEntry entry;
+    uint32_t pred_bits = data & 0xFFFFFFFF;
+    memcpy(&entry.pred, &pred_bits, sizeof(pred_bits));
+    uint64_t cost_bits = (data >> 32) & 0xFFFF;
+    entry.has_cost = cost_bits != NO_COST;
+    entry.cost = cost_bits / 4.0;
+    entry.hit = (data >> 49) & 1;
+    return entry;
+  }
+
+  void write(uint64_t key, const TableEntry &entry) {
+    Slot &slot = slots[key & mask];
+    uint64_t data = pack(entry);
+    slot.data.store(data, memory_order_relaxed);
+    slot.check.store(key ^ data, memory_order_relaxed);
+  }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef VALUE_VECTOR_H
+#define VALUE_VECTOR_H
+
+#include <cstdint>
+#include <random>
+#include <array>
+#include "polynomial.h"
+using namespace std;
+
+/*
+A node's polynomial as its values at a few fixed random points mod a prime,
+plus a few summaries that are exact because nothing ever cancels (all
+coefficients are positive): the coefficient sum, the total degree, the
+constant term and an upper bound on the number of terms.
+
+Adding or multiplying two of these is a fixed length loop over the points
+rather than a hash map product, and equal polynomials always get equal
+vectors. Different polynomials get equal vectors with probability about
+deg / 2^31 per point, so a match only ever means "worth checking exactly".
+*/
+
+const int N_POINTS = 8;
+const uint64_t VALUE_PRIME = 2147483647; // 2^31 - 1
+// the exact summaries saturate here instead of overflowing
+const long long VALUE_CAP = 1LL << 60;
+
+inline uint32_t mod_prime(uint64_t x) {
+  // x < 2^62, folding twice brings it under 2^31 + 1
+  x = (x & VALUE_PRIME) + (x >> 31);
+  x = (x & VALUE_PRIME) + (x >> 31);
+  return x >= VALUE_PRIME ? x - VALUE_PRIME : x;
+}
+
+inline long long capped(long long x) {
+  return x > VALUE_CAP ? VALUE_CAP : x;
+}
+
+struct ValueVector {
+  bool ready = false;
+  array<uint32_t, N_POINTS> v;
+  long long coeff_sum;
+  int total_deg;
+  long long constant;
+  long long max_terms;
+
+  uint64_t fingerprint() const {
+    uint64_t fp = 0x9e3779b97f4a7c15;
+    for (int k = 0; k < N_POINTS; k++) {
+      fp = (fp ^ v[k]) * 0x100000001b3;
+    }
+    return fp;
+  }
+
+  bool same_values(const ValueVector &other) const {
+    return v == other.v && coeff_sum == other.coeff_sum;
+  }
+};
+
+// random evaluation points, points[i][k] is variable i at point k
+vector<array<uint32_t, N_POINTS>> random_points(int n_var, mt19937 &gen) {
+  uniform_int_distribution<uint32_t> distr(1, VALUE_PRIME - 1);
+  vector<array<uint32_t, N_POINTS>> points(n_var);
+  for (int i = 0; i < n_var; i++) {
+    for (int k = 0; k < N_POINTS; k++) points[i][k] = distr(gen);
+  }
+  return points;
+}
+
+ValueVector values_of(const Polynomial &poly, const vector<array<uint32_t, N_POINTS>> &points) {
+  ValueVector out;
+  out.ready = true;
+  out.v.fill(0);
+  out.coeff_sum = 0;
+  out.total_deg = 0;
+  out.constant = 0;
+  out.max_terms = 0;
+  for (auto const& [key, val] : poly.poly_map) {
+    if (val == 0) continue;
+    int deg = 0;
+    for (auto &power : key) deg += power;
+    out.total_deg = max(out.total_deg, deg);
+    out.coeff_sum = capped(out.coeff_sum + val);
+    out.max_terms += 1;
+    if (deg == 0) out.constant = val;
+
+    for (int k = 0; k < N_POINTS; k++) {
+      uint64_t term = val;
+      for (int i = 0; i < poly.n_var; i++) {
+        for (int p = 0; p < key[i]; p++) term = mod_prime(term * points[i][k]);
+      }
+      out.v[k] = mod_prime((uint64_t) out.v[k] + term);
+    }
+  }
+  return out;
+}
+
+ValueVector add_values(const ValueVector &a, const ValueVector &b) {
+  ValueVector out;
+  out.ready = true;
+  for (int k = 0; k < N_POINTS; k++) {
+    out.v[k] = mod_prime((uint64_t) a.v[k] + b.v[k]);
+  }
+  out.coeff_sum = capped(a.coeff_sum + b.coeff_sum);
+  out.total_deg = max(a.total_deg, b.total_deg);
+  out.constant = capped(a.constant + b.constant);
+  out.max_terms = capped(a.max_terms + b.max_terms);
+  return out;
+}
+
+ValueVector mult_values(const ValueVector &a, const ValueVector &b) {
+  ValueVector out;
+  out.ready = true;
+  for (int k = 0; k < N_POINTS; k++) {
+    out.v[k] = mod_prime((uint64_t) a.v[k] * b.v[k]);
+  }
+  auto times = [](long long x, long long y) {
+    return (x != 0 && y > VALUE_CAP / x) ? VALUE_CAP : x * y;
+  };
+  out.coeff_sum = times(a.coeff_sum, b.coeff_sum);
+  out.total_deg = a.total_deg + b.total_deg;
+  out.constant = times(a.constant, b.constant);
+  out.max_terms = times(a.max_terms, b.max_terms);
+  return out;
+}
+
+#endif
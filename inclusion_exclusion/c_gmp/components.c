@@ -0,0 +1,96 @@
+#include "satsolver.h"
+
+static unsigned long find(unsigned long *parent, unsigned long v) {
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+/*
+ * Splits a formula into parts that share no variables, so each one can go
+ * through inclusion-exclusion on its own. Variables are joined with
+ * union-find for every clause they share, and each clause goes with the
+ * part its variables ended up in.
+ *
+ * Params:
+ *     input - the whole formula
+ *     components - set to an array with one DimacsInfo per part, biggest
+ *                  first. Their clauses arrays are new but the literals are
+ *                  still input's, and numLiterals is still input's so
+ *                  literal values don't need changing
+ *     variables - set to the number of distinct variables in each part
+ * Return:
+ *     number of parts. Clauses with no literals get a part each
+ */
+unsigned long split_components(DimacsInfo input, DimacsInfo **components, unsigned long **variables) {
+    unsigned long n = input.numLiterals;
+    unsigned long *parent = malloc((n + 1) * sizeof(unsigned long));
+    assert(parent != NULL);
+    for (unsigned long v = 0; v <= n; v++) parent[v] = v;
+    for (unsigned long i = 0; i < input.numClauses; i++) {
+        Clause *clause = &input.clauses[i];
+        for (unsigned long l = 1; l < clause->numLiterals; l++) {
+            unsigned long a = find(parent, literal_value(clause->literals[0]));
+            unsigned long b = find(parent, literal_value(clause->literals[l]));
+            if (a != b) parent[a] = b;
+        }
+    }
+
+    // number the parts, index[root] is the root's part + 1 once it has one
+    unsigned long *index = calloc(n + 1, sizeof(unsigned long));
+    unsigned long *part = malloc((input.numClauses + 1) * sizeof(unsigned long));
+    unsigned long *sizes = calloc(input.numClauses + 1, sizeof(unsigned long));
+    assert(index != NULL && part != NULL && sizes != NULL);
+    unsigned long numParts = 0;
+    for (unsigned long i = 0; i < input.numClauses; i++) {
+        Clause *clause = &input.clauses[i];
+        if (clause->numLiterals == 0) {
+            part[i] = numParts++;
+        } else {
+            unsigned long root = find(parent, literal_value(clause->literals[0]));
+            if (!index[root]) index[root] = ++numParts;
+            part[i] = index[root] - 1;
+        }
+        sizes[part[i]]++;
+    }
+
+    // biggest first, so they get started first when solved in parallel
+    unsigned long *order = malloc((numParts + 1) * sizeof(unsigned long));
+    unsigned long *rank = malloc((numParts + 1) * sizeof(unsigned long));
+    assert(order != NULL && rank != NULL);
+    for (unsigned long p = 0; p < numParts; p++) order[p] = p;
+    for (unsigned long p = 1; p < numParts; p++) {
+        unsigned long cur = order[p], q = p;
+        for (; q > 0 && sizes[order[q - 1]] < sizes[cur]; q--) order[q] = order[q - 1];
+        order[q] = cur;
+    }
+    for (unsigned long p = 0; p < numParts; p++) rank[order[p]] = p;
+
+    DimacsInfo *parts = malloc((numParts + 1) * sizeof(DimacsInfo));
+    unsigned long *numVariables = calloc(numParts + 1, sizeof(unsigned long));
+    assert(parts != NULL && numVariables != NULL);
+    for (unsigned long p = 0; p < numParts; p++) {
+        parts[rank[p]] = (DimacsInfo){malloc(sizes[p] * sizeof(Clause)), n, 0, input.literals};
+        assert(parts[rank[p]].clauses != NULL);
+    }
+    for (unsigned long i = 0; i < input.numClauses; i++) {
+        DimacsInfo *info = &parts[rank[part[i]]];
+        info->clauses[info->numClauses++] = input.clauses[i];
+    }
+    for (unsigned long v = 1; v <= n; v++) {
+        unsigned long root = find(parent, v);
+        if (index[root]) numVariables[rank[index[root] - 1]]++;
+    }
+
+    free(parent);
+    free(index);
+    free(part);
+    free(sizes);
+    free(order);
+    free(rank);
+    *components = parts;
+    *variables = numVariables;
+    return numParts;
+}
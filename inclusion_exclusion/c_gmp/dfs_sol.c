@@ -0,0 +1,115 @@
+#include "satsolver.h"
+#include <gmp.h>
+
+// one level of the depth first walk: the merged clause of the subset so far
+// and the next clause to try adding to it
+typedef struct DfsFrame {
+    GenChild child;
+    unsigned long next;
+    const uint64_t *compatible; // the clauses it can take, see clause_masks
+} DfsFrame;
+
+static unsigned long next_compatible(const uint64_t *compatible, unsigned long from, unsigned long total_clauses) {
+    // first clause from on whose bit is set, total_clauses if there's none
+    size_t words = compatible_words(total_clauses);
+    size_t word = from / 64;
+    if (word >= words) return total_clauses;
+    uint64_t bits = compatible[word] & (~(uint64_t)0 << (from % 64));
+    while (!bits) {
+        if (++word == words) return total_clauses;
+        bits = compatible[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+static void release(LiteralArena *arena, GenChild *child) {
+    // child is always the last clause pushed to its arena
+    if (child->dense) arena->words_used = child->offset;
+    else arena->used = child->offset;
+}
+
+/*
+* Depth first alternative to gen_num_sol. Walks every subset of up to to_k
+* clauses whose merge has no conflict, keeping only the current path, and
+* adds the number of solutions of each one with at least from_k clauses to
+* sums[size of the subset]. Sums are not signed, that is left to the caller.
+*
+* parameters:
+*  clauses: input clauses, with their masks and rows set (see clause_masks)
+*  from_k, to_k: depths to count, 1 <= from_k <= to_k. Depths below from_k are
+*                walked again but not counted, so the walk can be deepened
+*                a few levels at a time
+*  sums: sums[k] for k in from_k..to_k get added to
+*
+* A subset's merge lives in arenas[depth % 2] and is merged into the other
+* one, so the two clauses of merge_child are never in the same arena. Each
+* arena is only ever a stack of at most to_k / 2 + 1 clauses, which is all
+* the memory the walk needs beyond the to_k frames and their sets of
+* compatible clauses. Only the clauses in the set are merged, every other
+* one would conflict.
+*/
+void dfs_num_sol(Clause *clauses, unsigned long total_clauses, unsigned long total_literals,
+                 unsigned long from_k, unsigned long to_k, mpz_t *sums)
+{
+    LiteralArena arenas[2];
+    arena_init(&arenas[0], 2 * total_literals + 1);
+    arena_init(&arenas[1], 2 * total_literals + 1);
+    DfsFrame *stack = malloc((to_k + 1) * sizeof(DfsFrame));
+    assert(stack != NULL);
+    size_t words = mask_words(total_literals);
+    size_t row_words = compatible_words(total_clauses);
+    // sets[(d - 1) * row_words] is the set of stack[d - 1] for d > 1, the
+    // first frame uses its clause's row
+    uint64_t *sets = malloc((to_k + 1) * row_words * sizeof(uint64_t));
+    assert(sets != NULL);
+
+    // hist[d * (total_literals + 1) + e] counts the subsets of size d with 2^e
+    // solutions, folded into sums[d] at the end
+    uint64_t *hist = calloc((to_k + 1) * (total_literals + 1), sizeof(uint64_t));
+    assert(hist != NULL);
+    for (unsigned long i = 0; i < total_clauses; ++i) {
+        // subsets whose first clause is i, stack[d - 1] holds the one of size d
+        GenChild first = {i, 0, clauses[i].numLiterals, false, 0, 0, 1};
+        if (use_dense(clauses[i].numLiterals, total_literals)) {
+            first.offset = arena_push_masks(&arenas[1], clauses[i].masks, words);
+            first.dense = true;
+        } else {
+            first.offset = arena_push(&arenas[1], clauses[i].literals, clauses[i].numLiterals);
+        }
+        if (from_k <= 1) hist[total_literals + 1 + count_solutions(first.numLiterals, total_literals)]++;
+        stack[0] = (DfsFrame){first, i + 1, clauses[i].compatible};
+        unsigned long depth = 1;
+
+        while (depth > 0) {
+            DfsFrame *top = &stack[depth - 1];
+            unsigned long j = depth == to_k ? total_clauses : next_compatible(top->compatible, top->next, total_clauses);
+            if (j == total_clauses) {
+                release(&arenas[depth % 2], &top->child);
+                depth--;
+                continue;
+            }
+            top->next = j + 1;
+            size_t offset;
+            bool dense;
+            long merged_size = merge_child(&clauses[j], &top->child, &arenas[depth % 2], &arenas[(depth + 1) % 2],
+                                           total_literals, &offset, &dense);
+            if (merged_size < 0) {
+                // every subset containing this one conflicts as well
+                continue;
+            }
+            uint64_t *set = sets + depth * row_words;
+            for (size_t w = 0; w < row_words; ++w) set[w] = top->compatible[w] & clauses[j].compatible[w];
+            depth++;
+            stack[depth - 1] = (DfsFrame){(GenChild){j, offset, merged_size, dense, 0, 0, 1}, j + 1, set};
+            if (depth >= from_k) hist[depth * (total_literals + 1) + count_solutions(merged_size, total_literals)]++;
+        }
+    }
+    for (unsigned long d = from_k; d <= to_k; ++d) {
+        fold_histogram(hist + d * (total_literals + 1), total_literals, sums[d]);
+    }
+    free(hist);
+    free(sets);
+    free(stack);
+    arena_free(&arenas[0]);
+    arena_free(&arenas[1]);
+}
@@ -1,5 +1,7 @@
 #include "satsolver.h"
 #include <gmp.h>
+#include <pthread.h>
+#include <string.h>
 
 int GEN_SIZE_START = 8;
 
@@ -9,98 +11,463 @@ unsigned long gen_size(unsigned long k, unsigned long total_clauses){
     return 100;
 }
 
-unsigned long count_solutions(Clause *clause, unsigned long total_literals){
-    unsigned long numLiterals = clause->numLiterals;
+unsigned long count_solutions(unsigned long numLiterals, unsigned long total_literals){
     //printf("counting solutionsss\n");
     //printf("numLiterals is %ld \n", numLiterals);
     // when we do big num then different way obviously
+    // a clause with more literals than variables has a repeat or a
+    // complementary pair, and total_literals - numLiterals would wrap
+    // around and index far past the end of hist
+    assert(numLiterals <= total_literals);
     unsigned long x = total_literals - numLiterals;
     return x;
 }
 
+void fold_histogram(uint64_t *hist, unsigned long total_literals, mpz_t total_solution){
+    // hist[e] counts the clauses with 2^e solutions, add them all to
+    // total_solution and clear hist for the next generation
+    mpz_t temp;
+    mpz_init(temp);
+    for (unsigned long e = 0; e <= total_literals; ++e){
+        if (!hist[e]) continue;
+        mpz_set_ui(temp, hist[e]);
+        mpz_mul_2exp(temp, temp, e);
+        mpz_add(total_solution, total_solution, temp);
+        hist[e] = 0;
+    }
+    mpz_clear(temp);
+}
+
+static void fold_carries(uint64_t *carries, unsigned long total_literals, mpz_t total_solution){
+    // each carries[e] is 2^64 more subsets with 2^e solutions, see add_count
+    mpz_t temp;
+    mpz_init(temp);
+    for (unsigned long e = 0; e <= total_literals; ++e){
+        if (!carries[e]) continue;
+        mpz_set_ui(temp, carries[e]);
+        mpz_mul_2exp(temp, temp, e + 64);
+        mpz_add(total_solution, total_solution, temp);
+    }
+    mpz_clear(temp);
+}
+
+// How far the generation's sum can still go, shared by all of gen_num_sol's
+// threads. On odd k the sum can only grow and on even k I_k can only shrink,
+// so once even the most the unfinished parents could add can't change the
+// verdict it's decided without them.
+typedef struct GenBound {
+    uint64_t *partial;          // the generation's counts so far, by exponent
+    uint64_t *remaining;        // parents not done yet, see parent_bound
+    uint64_t *carries;          // times a count by exponent e wrapped, 2^(64 + e) each, see add_count
+    bool odd;
+    mpz_srcptr before;          // I_k of the last generation, NULL to never stop early
+    mpz_srcptr total_possible;
+    int decided;
+} GenBound;
+
+// what one thread of gen_num_sol needs, the parents are handed out in
+// blocks of PARENT_BLOCK through next_parent so no thread is left with all
+// the long ones
+typedef struct GenWorker {
+    GenSegment *prev;
+    int n_segments;
+    GenSegment *out;            // this thread's segment of the new generation
+    unsigned long *next_parent; // shared
+    unsigned long total_parents;
+    Clause *clauses;
+    unsigned long total_clauses;
+    unsigned long total_literals;
+    uint64_t *hist;             // this thread's counts since the last block, see publish
+    uint64_t *done;             // parent_bound of the parents it did since then
+    GenBound *bound;
+} GenWorker;
+
+#define PARENT_BLOCK 64
+// blocks a thread does between checks of the bound
+#define EARLY_CHECK_BLOCKS 64
+
+static bool parent_bound(GenChild *parent, unsigned long total_literals, uint64_t *bound){
+    // every child has at least the parent's literals, so the parent's
+    // children add at most 2^(n - |parent|) each. False, leaving bound as it
+    // was, if that doesn't fit in 64 bits
+    uint64_t *slot = &bound[count_solutions(parent->numLiterals, total_literals)];
+    uint64_t most, sum;
+    if (__builtin_mul_overflow((uint64_t)parent->later, parent->count, &most)) return false;
+    if (__builtin_add_overflow(*slot, most, &sum)) return false;
+    *slot = sum;
+    return true;
+}
+
+static void add_count(uint64_t *counts, uint64_t *carries, unsigned long e, uint64_t count){
+    // counts[e] += count from any thread, every wrap around adds one to
+    // carries[e]. The carry goes in first, so bound_decides, reading counts
+    // before carries, can see too much but never too little
+    uint64_t old = __atomic_load_n(&counts[e], __ATOMIC_SEQ_CST), sum;
+    while (true){
+        bool wraps = __builtin_add_overflow(old, count, &sum);
+        if (wraps) __atomic_fetch_add(&carries[e], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_compare_exchange_n(&counts[e], &old, sum, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return;
+        if (wraps) __atomic_fetch_sub(&carries[e], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void release(LiteralArena *arena, size_t offset, bool dense){
+    // hands back a merged clause that was the last thing pushed to arena
+    if (dense) arena->words_used = offset;
+    else arena->used = offset;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value){
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t set_word(GenChild *child, LiteralArena *arena, size_t word){
+    // word of the child's compatible set, whichever word it starts at
+    size_t first_word = (child->last_clause_num + 1) / 64;
+    return word < first_word ? 0 : arena->words[child->compatible + word - first_word];
+}
+
+static uint64_t child_hash(GenChild *child, LiteralArena *arena, unsigned long total_clauses,
+                           unsigned long total_literals){
+    // by the merged clause and the compatible set, the same clause is
+    // always in the same form (see merge_child) so either can be hashed as is
+    uint64_t hash = child->numLiterals;
+    if (child->dense){
+        for (size_t i = 0; i < 2 * mask_words(total_literals); ++i){
+            hash = mix(hash, arena->words[child->offset + i]);
+        }
+    } else {
+        Literal *literals = arena->literals + child->offset;
+        for (unsigned long i = 0; i < child->numLiterals; ++i){
+            hash = mix(hash, literals[i]);
+        }
+    }
+    for (size_t word = (child->last_clause_num + 1) / 64; word < compatible_words(total_clauses); ++word){
+        uint64_t bits = set_word(child, arena, word);
+        if (bits) hash = mix(mix(hash, word), bits);
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    return hash ^ (hash >> 33);
+}
+
+static bool same_child(GenChild *a, GenChild *b, LiteralArena *arena, unsigned long total_clauses,
+                       unsigned long total_literals){
+    if (a->numLiterals != b->numLiterals || a->later != b->later) return false;
+    if (a->dense){
+        for (size_t i = 0; i < 2 * mask_words(total_literals); ++i){
+            if (arena->words[a->offset + i] != arena->words[b->offset + i]) return false;
+        }
+    } else {
+        Literal *la = arena->literals + a->offset, *lb = arena->literals + b->offset;
+        for (unsigned long i = 0; i < a->numLiterals; ++i){
+            if (la[i] != lb[i]) return false;
+        }
+    }
+    unsigned long last = a->last_clause_num < b->last_clause_num ? a->last_clause_num : b->last_clause_num;
+    for (size_t word = (last + 1) / 64; word < compatible_words(total_clauses); ++word){
+        if (set_word(a, arena, word) != set_word(b, arena, word)) return false;
+    }
+    return true;
+}
+
+static void grow_slots(GenSegment *segment){
+    // a slot's tag is all it takes to place it, see keep_child
+    size_t old_count = segment->slot_count;
+    uint64_t *old_slots = segment->slots;
+    segment->slot_count *= 2;
+    segment->slots = calloc(segment->slot_count, sizeof(uint64_t));
+    assert(segment->slots != NULL);
+    size_t mask = segment->slot_count - 1;
+    for (size_t i = 0; i < old_count; ++i){
+        if (!old_slots[i]) continue;
+        size_t slot = (old_slots[i] >> 32) & mask;
+        while (segment->slots[slot]) slot = (slot + 1) & mask;
+        segment->slots[slot] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+static void keep_child(GenSegment *segment, GenChild *child, unsigned long total_clauses,
+                       unsigned long total_literals){
+    /* Params:
+         segment - where child goes, its merged clause and then its compatible
+                   set are the last things pushed to the segment's arena
+         child - with its count of subsets
+
+       Subsets with the same merged clause and the same compatible set count
+       the same and have the same children, so there only needs to be one
+       entry for all of them. If the segment already has one, child's count
+       goes to it and child's clause and set are handed back to the arena,
+       unless the sum doesn't fit in 64 bits.
+
+       A slot holds the top half of the child's hash over its index + 1, 0
+       if it's free. The tag places it and rules out most other children
+       without going to them. Segments without slots keep every child.
+    */
+    uint64_t tag = 0;
+    size_t slot = 0;
+    if (segment->slots){
+        tag = child_hash(child, &segment->arena, total_clauses, total_literals) >> 32;
+        size_t mask = segment->slot_count - 1;
+        for (slot = tag & mask; segment->slots[slot]; slot = (slot + 1) & mask){
+            if (segment->slots[slot] >> 32 != tag) continue;
+            GenChild *kept = &segment->children[(uint32_t)segment->slots[slot] - 1];
+            uint64_t count;
+            // a count that would wrap around stays a separate entry
+            if (same_child(kept, child, &segment->arena, total_clauses, total_literals) &&
+                !__builtin_add_overflow(kept->count, child->count, &count)){
+                kept->count = count;
+                segment->arena.words_used = child->compatible;
+                release(&segment->arena, child->offset, child->dense);
+                return;
+            }
+        }
+    }
+    // add the merged clause to the new generation, and enlarge arrays if needed
+    if (segment->size == segment->capacity){
+        segment->capacity = segment->capacity * 2;
+        segment->children = (GenChild *)realloc(segment->children, segment->capacity * sizeof(GenChild));
+        assert(segment->children != NULL);
+    }
+    segment->children[segment->size++] = *child;
+    if (!segment->slots) return;
+    assert(segment->size < UINT32_MAX);
+    segment->slots[slot] = tag << 32 | segment->size;
+    if (2 * segment->size > segment->slot_count) grow_slots(segment);
+}
+
+static void clear_slots(GenSegment *segment){
+    if (segment->slots) memset(segment->slots, 0, segment->slot_count * sizeof(uint64_t));
+}
+
+static void publish(GenWorker *w){
+    // a parent's children have to be in partial before its bound comes off
+    // remaining, bound_decides reads them the other way round
+    for (unsigned long e = 0; e <= w->total_literals; ++e){
+        if (!w->hist[e]) continue;
+        add_count(w->bound->partial, w->bound->carries, e, w->hist[e]);
+        w->hist[e] = 0;
+    }
+    for (unsigned long e = 0; e <= w->total_literals; ++e){
+        if (!w->done[e]) continue;
+        __atomic_fetch_sub(&w->bound->remaining[e], w->done[e], __ATOMIC_SEQ_CST);
+        w->done[e] = 0;
+    }
+}
+
+static bool bound_decides(GenBound *bound, unsigned long total_literals){
+    /* Return:
+         whether the verdict for this k is already known: sat on odd k if
+         I_k can't reach 2^n any more, unsat on even k if it can't drop below
+
+       Every parent is in remaining, partial or both (see publish), so
+       partial + remaining is at least what the generation will add up to.
+    */
+    mpz_t most, temp;
+    mpz_init(most);
+    mpz_init(temp);
+    for (int pass = 0; pass < 3; ++pass){
+        uint64_t *counts = pass == 0 ? bound->remaining : pass == 1 ? bound->partial : bound->carries;
+        for (unsigned long e = 0; e <= total_literals; ++e){
+            uint64_t count = __atomic_load_n(&counts[e], __ATOMIC_SEQ_CST);
+            if (!count) continue;
+            mpz_set_ui(temp, count);
+            mpz_mul_2exp(temp, temp, pass == 2 ? e + 64 : e);
+            mpz_add(most, most, temp);
+        }
+    }
+    bool decided;
+    if (bound->odd){
+        mpz_add(most, bound->before, most);
+        decided = mpz_cmp(most, bound->total_possible) < 0;
+    } else {
+        mpz_sub(most, bound->before, most);
+        decided = mpz_cmp(most, bound->total_possible) >= 0;
+    }
+    mpz_clear(most);
+    mpz_clear(temp);
+    return decided;
+}
 
-void free_clauses(GenChild **prev_generation, unsigned long prev_gen_size){
-    GenChild *prev_gen = *prev_generation;
-    for(size_t i = 0; i < prev_gen_size; ++i){
-        GenChild cur_child = prev_gen[i];
-        Clause *clause_to_free = cur_child.merged_clause;
-        free(clause_to_free->literals);
-        free(clause_to_free);
+static void *expand_parents(void *arg){
+    GenWorker *w = arg;
+    GenSegment *out = w->out;
+    unsigned long blocks = 0;
+    while (!__atomic_load_n(&w->bound->decided, __ATOMIC_RELAXED)){
+        unsigned long start = __atomic_fetch_add(w->next_parent, PARENT_BLOCK, __ATOMIC_RELAXED);
+        if (start >= w->total_parents) break;
+        unsigned long end = start + PARENT_BLOCK < w->total_parents ? start + PARENT_BLOCK : w->total_parents;
+        // find the segment the block starts in, a block can run into the next ones
+        int s = 0;
+        unsigned long i = start;
+        while (i >= w->prev[s].size){
+            i -= w->prev[s].size;
+            s++;
+        }
+        for (unsigned long n = start; n < end; ++n, ++i){
+            while (i >= w->prev[s].size){
+                i -= w->prev[s].size;
+                s++;
+            }
+            // iterate over each entry to see the new generation k-pairs that can be made
+            GenChild cur_child = w->prev[s].children[i];
+            unsigned long last_clause = cur_child.last_clause_num;
+            size_t first_word = (last_clause + 1) / 64;
+            const uint64_t *compatible = w->prev[s].arena.words + cur_child.compatible;
+            // loop over the clauses we can merge this one with, the others
+            // would conflict
+            for (size_t word = first_word; word < compatible_words(w->total_clauses); ++word){
+                uint64_t bits = compatible[word - first_word];
+                while (bits){
+                    unsigned long cur_clause_num = word * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    size_t offset;
+                    bool dense;
+                    long merged_size = merge_child(&w->clauses[cur_clause_num], &cur_child, &w->prev[s].arena,
+                                                   &out->arena, w->total_literals, &offset, &dense);
+                    if (merged_size < 0){
+                        continue;
+                    }
+                    unsigned long num_sol = count_solutions(merged_size, w->total_literals);
+                    // what hist can't hold goes straight to carries, that's
+                    // only ever too much for bound_decides until publish
+                    if (__builtin_add_overflow(w->hist[num_sol], cur_child.count, &w->hist[num_sol])){
+                        __atomic_fetch_add(&w->bound->carries[num_sol], 1, __ATOMIC_SEQ_CST);
+                    }
+                    GenChild child = {cur_clause_num, offset, merged_size, dense, 0, 0, cur_child.count};
+                    child.later = arena_push_compatible(&out->arena, compatible, last_clause,
+                                                        &w->clauses[cur_clause_num], cur_clause_num,
+                                                        w->total_clauses, &child.compatible);
+                    if (!child.later){
+                        // counted, but nothing can be added to it
+                        release(&out->arena, offset, dense);
+                        continue;
+                    }
+                    keep_child(out, &child, w->total_clauses, w->total_literals);
+                }
+            }
+            // can only fail when remaining did, and then nothing reads done
+            parent_bound(&cur_child, w->total_literals, w->done);
+        }
+        publish(w);
+        if (w->bound->before && ++blocks % EARLY_CHECK_BLOCKS == 0 && bound_decides(w->bound, w->total_literals)){
+            __atomic_store_n(&w->bound->decided, 1, __ATOMIC_RELAXED);
+        }
     }
+    return NULL;
 }
 
 /*
 * parameters:
-*  prev_generation: an array of GenChilds that stores the solutions to
-                    the last merge (so if we are calling with k = 3 then
-                    it stores the sols to k = 2) - technically the memory address
-                    of the variable that stores the array is what prev_generation is
+*  segments: the current generation in segments[0..n_threads) and the one
+             being built in segments[n_threads..2 * n_threads). Thread t
+             only writes to segment n_threads + t, its children and its arena.
+             The two halves are swapped before returning, so the first
+             half always belongs to the current generation (so if we are
+             calling with k = 3 then it holds the merges for k = 2)
+*  n_threads: threads to expand the generation with
+*  I_k, total_possible_soln: I_k so far (up to k - 1) and 2^n, for checking
+                             the verdict while the generation is being made.
+                             NULL if the whole generation is wanted regardless
+*
+* returns true if the verdict for k (sat on odd k, unsat on even k) was
+* reached before the generation was finished. total_solution and the new
+* generation are then incomplete, they're only good for freeing.
 */
-void gen_num_sol(GenChild **prev_generation, unsigned long *array_size, unsigned long total_clauses, 
-                 unsigned long total_literals, unsigned long k, Clause* clauses, int gen_num, mpz_t total_solution)
+bool gen_num_sol(GenSegment *segments, int n_threads, unsigned long total_clauses,
+                 unsigned long total_literals, unsigned long k, Clause* clauses, mpz_t total_solution,
+                 mpz_t I_k, mpz_t total_possible_soln)
 {
     // so we know that when k is 2, we have the results of the 1st generation ready and we
     // want to calculate the results of the next generation
-    //printf("generating num sol for generation number: %d \n", gen_num);
-    unsigned long prev_gen_size = *array_size;
-    GenChild *prev_gen = *prev_generation;
-    unsigned long new_gen_size = GEN_SIZE_START; // this is the max size possible
-    GenChild *new_gen = (GenChild *)malloc(new_gen_size * sizeof(GenChild));
-    unsigned long cur_index = 0;
-    
-    mpz_t temp; // temporarily holds the solution for a particular clause
-    mpz_init(temp);
-    unsigned long base = 2;
-    for(unsigned long i = 0; i < prev_gen_size; ++i){
-        // iterate over each entry to see the new generation k-pairs that can be made
-        GenChild cur_child = prev_gen[i];
-        unsigned long last_clause = cur_child.last_clause_num;
-        // loop over all claues we can merge this one with
-        for (unsigned long j = last_clause + 1; j < total_clauses; ++j){
-            int cur_clause_num = j;
-            // we need to merge cur_child_clause with this clause
-            // clause array should be such that clause 0 is at index 0
-            //printf("now merging clause number %d with merged clause where last clause is %ld \n",
-                  //  cur_clause_num, last_clause);
-            Clause *result = merge(&clauses[cur_clause_num], cur_child.merged_clause);
-            if (result == NULL){
-                //printf("numsol is zero so NOT making the entry in generation \n"); 
-                continue;
-            }
-            unsigned long num_sol = count_solutions(result, total_literals);
-            //printf("numsol is nonzero so making the entry in generation \n");
-            // add the merged clause to the new generation, and enlarge array if needed
-            if (cur_index == new_gen_size){
-                //printf("enlarging the array");
-                new_gen_size = new_gen_size * 2;
-                //printf("requesting more memory: %ld\n", new_gen_size);
-                new_gen = (GenChild *)realloc(new_gen, new_gen_size * sizeof(GenChild));
-                //if (new_gen == NULL) {
-                //  printf("realloc gives NULL\n");
-                //  printf("requested size: %ld\n", new_gen_size);
-                //}
-                assert(new_gen != NULL);
-            }
-            new_gen[cur_index] = (GenChild){cur_clause_num, result};
-            cur_index++; // this will tell the true number of childs 
-            //total_solution += num_sol;
-            mpz_ui_pow_ui(temp, base, num_sol);
-            mpz_add(total_solution, total_solution, temp);
+    GenSegment *prev = segments, *next = segments + n_threads;
+    unsigned long total_parents = 0;
+    for (int t = 0; t < n_threads; ++t) total_parents += prev[t].size;
+    unsigned long next_parent = 0;
+
+    GenBound bound = {calloc(total_literals + 1, sizeof(uint64_t)), calloc(total_literals + 1, sizeof(uint64_t)),
+                      calloc(total_literals + 1, sizeof(uint64_t)), k % 2 == 1, I_k, total_possible_soln, 0};
+    assert(bound.partial != NULL && bound.remaining != NULL && bound.carries != NULL);
+    for (int t = 0; t < n_threads; ++t){
+        for (unsigned long i = 0; i < prev[t].size; ++i){
+            // without a bound on the rest the generation has to be finished
+            if (!parent_bound(&prev[t].children[i], total_literals, bound.remaining)) bound.before = NULL;
         }
     }
-    // we need to free the previous generation, obviously also the merged clauses 
-    // within it, however, we do not free the merged clauses in gen 1
-    if (gen_num != 2){
-        free_clauses(prev_generation, prev_gen_size);
+
+    GenWorker *workers = malloc(n_threads * sizeof(GenWorker));
+    pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+    assert(workers != NULL && threads != NULL);
+    for (int t = 0; t < n_threads; ++t){
+        next[t].size = 0;
+        clear_slots(&next[t]);
+        // solutions are counted by exponent and only become a bignum at the end
+        uint64_t *hist = calloc(total_literals + 1, sizeof(uint64_t));
+        uint64_t *done = calloc(total_literals + 1, sizeof(uint64_t));
+        assert(hist != NULL && done != NULL);
+        workers[t] = (GenWorker){prev, n_threads, &next[t], &next_parent, total_parents,
+                                 clauses, total_clauses, total_literals, hist, done, &bound};
+    }
+    // the calling thread is worker 0
+    for (int t = 1; t < n_threads; ++t){
+        // not inside the assert, which -DNDEBUG drops
+        int rc = pthread_create(&threads[t], NULL, expand_parents, &workers[t]);
+        assert(rc == 0);
+        (void) rc;
+    }
+    expand_parents(&workers[0]);
+    for (int t = 1; t < n_threads; ++t) pthread_join(threads[t], NULL);
+
+    fold_histogram(bound.partial, total_literals, total_solution);
+    fold_carries(bound.carries, total_literals, total_solution);
+    free(bound.partial);
+    free(bound.remaining);
+    free(bound.carries);
+    for (int t = 0; t < n_threads; ++t){
+        free(workers[t].hist);
+        free(workers[t].done);
+        // we need to free the previous generation, its merged clauses all go at
+        // once with its arena, which is then reused for the next generation
+        arena_reset(&prev[t].arena);
+        GenSegment spare = prev[t];
+        prev[t] = next[t];
+        next[t] = spare;
+    }
+    free(workers);
+    free(threads);
+    return bound.decided;
+}
+
+void segments_init(GenSegment *segments, int n, size_t arena_capacity, bool merge_duplicates){
+    // with merge_duplicates the segments get a hash table, see keep_child.
+    // It costs a cache miss or so per child, which only pays off when a good
+    // share of them are duplicates, as on symmetric instances
+    for (int t = 0; t < n; ++t){
+        segments[t].size = 0;
+        segments[t].capacity = GEN_SIZE_START;
+        segments[t].children = malloc(segments[t].capacity * sizeof(GenChild));
+        assert(segments[t].children != NULL);
+        arena_init(&segments[t].arena, arena_capacity);
+        segments[t].slot_count = 2 * GEN_SIZE_START;
+        segments[t].slots = NULL;
+        if (merge_duplicates){
+            segments[t].slots = calloc(segments[t].slot_count, sizeof(uint64_t));
+            assert(segments[t].slots != NULL);
+        }
+    }
+}
+
+void segments_free(GenSegment *segments, int n){
+    for (int t = 0; t < n; ++t){
+        free(segments[t].children);
+        free(segments[t].slots);
+        arena_free(&segments[t].arena);
     }
-    free(prev_gen);
-    *prev_generation = new_gen;
-    *array_size = cur_index;
-    mpz_clear(temp);
-    return;
 }
 
-/* This function populates the first generation in generations (an array of GenChilds)
+/* This function populates the first generation, all of it in segment
  *
  * The first generation will consist of the following:
  * 
@@ -109,29 +476,53 @@ void gen_num_sol(GenChild **prev_generation, unsigned long *array_size, unsigned
  * - ith GenChild will consist of the following:
  *      - i as the last clause num
  *      - num of solutions of ith clause
- *      - ith clause
+ *      - ith clause, copied into arena, as masks if it's past the switch
+ *        point already (needs clause_masks to have been called)
+ *      - the later clauses it merges with, from its row
+ *
+ * - clauses that merge with no later clause are counted but left out,
+ *   they have no children
  */ 
 
-void populate_first_gen(GenChild **generations, Clause *clauses, unsigned long total_literals, 
+void populate_first_gen(GenSegment *segment, Clause *clauses, unsigned long total_literals, 
                         unsigned long total_clauses, mpz_t first_gen_sol) {
     
-    GenChild *first_gen = *generations;
-    mpz_t temp; // temporarily holds the solution for a particular clause
-    mpz_init(temp);
-    unsigned long base = 2;
+    if (segment->capacity < total_clauses){
+        segment->capacity = total_clauses;
+        segment->children = realloc(segment->children, segment->capacity * sizeof(GenChild));
+        assert(segment->children != NULL);
+    }
+    LiteralArena *arena = &segment->arena;
+    uint64_t *hist = calloc(total_literals + 1, sizeof(uint64_t));
+    assert(hist != NULL);
 
+    segment->size = 0;
+    clear_slots(segment);
     for (size_t i = 0; i < total_clauses; i++) {
-        unsigned long num_soln = count_solutions(&clauses[i], total_literals);
+        unsigned long num_soln = count_solutions(clauses[i].numLiterals, total_literals);
         // summing solutions to all clauses
-        mpz_ui_pow_ui(temp, base, num_soln);
-        mpz_add(first_gen_sol, first_gen_sol, temp);
+        hist[num_soln]++;
         // for first gen, the last_clause_num is just the clause number
         unsigned long last_clause_num = i;
-        GenChild new_child = {last_clause_num, &clauses[i]};
-        first_gen[i] = new_child;
+        GenChild new_child = {last_clause_num, 0, clauses[i].numLiterals, false, 0, 0, 1};
+        if (use_dense(clauses[i].numLiterals, total_literals)) {
+            new_child.offset = arena_push_masks(arena, clauses[i].masks, mask_words(total_literals));
+            new_child.dense = true;
+        } else {
+            new_child.offset = arena_push(arena, clauses[i].literals, clauses[i].numLiterals);
+        }
+        // the row and'ed with itself is the row, so it stands in for a parent
+        new_child.later = arena_push_compatible(arena, clauses[i].compatible + (i + 1) / 64, i, &clauses[i], i,
+                                                total_clauses, &new_child.compatible);
+        if (!new_child.later) {
+            release(arena, new_child.offset, new_child.dense);
+            continue;
+        }
+        keep_child(segment, &new_child, total_clauses, total_literals);
     }
 
-    mpz_clear(temp);
+    fold_histogram(hist, total_literals, first_gen_sol);
+    free(hist);
     return; 
 }
 
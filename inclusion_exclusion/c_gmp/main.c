@@ -1,9 +1,20 @@
 #include "satsolver.h"
 #include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <gmp.h>
 
 
 int NUM_TRIALS = 1;
+// with --dfs, how many more depths each pass of the depth first walk goes
+int DFS_DEPTH_STEP = 2;
+// threads gen_num_sol expands each generation with, --threads N, defaults to
+// one per core
+int NUM_THREADS = 1;
+// --merge-duplicates, keep one entry per distinct merged clause in each
+// generation, see keep_child
+bool MERGE_DUPLICATES = false;
 
 
 Clause *basicTest(){
@@ -35,7 +46,8 @@ Clause *basicTest(){
 }
 
 
-void sat_solver(DimacsInfo input){
+bool sat_solver(DimacsInfo input, int n_threads){
+    // returns whether input is satisfiable
     Clause *clauses_array = input.clauses;
     unsigned long total_literals = input.numLiterals;
     unsigned long total_clauses = input.numClauses;
@@ -49,16 +61,18 @@ void sat_solver(DimacsInfo input){
     //mpz_out_str(stdout, 10, total_possible_soln);
     //printf("\n");
 
-    // first generation will have (# of clauses) GenChilds
-    unsigned long gen_array_size = total_clauses;
-    GenChild *generation = malloc(gen_array_size * sizeof(GenChild));
+    // the current generation and the one being built, n_threads segments each
+    GenSegment *segments = malloc(2 * n_threads * sizeof(GenSegment));
+    segments_init(segments, 2 * n_threads, 8 * total_clauses + 1, MERGE_DUPLICATES);
+    uint64_t *masks = clause_masks(clauses_array, total_clauses, total_literals);
 
     mpz_t I_k;
     mpz_init(I_k);
 
     mpz_t temp;
     mpz_init(temp);
-    populate_first_gen(&generation, clauses_array, total_literals, total_clauses, temp);
+    // first generation will have (# of clauses) GenChilds
+    populate_first_gen(&segments[0], clauses_array, total_literals, total_clauses, temp);
     mpz_add(I_k, I_k, temp);
     mpz_set_ui(temp, 0);
     
@@ -67,12 +81,17 @@ void sat_solver(DimacsInfo input){
     
     //if (first_gen_soln < total_possible_soln) {
     if (mpz_cmp(I_k, total_possible_soln) < 0 ){
-        printf("sat\n");
-        return;
+        segments_free(segments, 2 * n_threads);
+        free(segments);
+        free(masks);
+        mpz_clear(temp);
+        mpz_clear(I_k);
+        mpz_clear(total_possible_soln);
+        return true;
     }
     
     
-    int gen_num = 2;
+    int verdict = -1; // sat or unsat once known
     
     for (size_t k = 2; k <= total_clauses; ++k){
         // at the odd step
@@ -80,9 +99,12 @@ void sat_solver(DimacsInfo input){
         //printf("cur size of gen array: %ld\n", gen_array_size);
         if (k % 2 == 1) {
             
-            gen_num_sol(&generation, &gen_array_size, total_clauses, 
-                        total_literals, k, clauses_array, gen_num, temp);
-            //print_generation(generation, gen_array_size, gen_num);
+            if (gen_num_sol(segments, n_threads, total_clauses, 
+                            total_literals, k, clauses_array, temp, I_k, total_possible_soln)) {
+                // decided part way through the generation
+                verdict = 1;
+                break;
+            }
             mpz_add(I_k, I_k, temp);
             mpz_set_ui(temp, 0);
             //I_k += num_soln_k_pairs;
@@ -90,16 +112,18 @@ void sat_solver(DimacsInfo input){
             // here we over estimated so if it is less than the CNF is SAT
             //if (I_k < total_possible_soln){
             if (mpz_cmp(I_k, total_possible_soln) < 0 ){
-                printf("sat\n");
+                verdict = 1;
                 break;
             }
             //printf("at step %ld \n", k);
                 
         // at the even step
         } else {
-            gen_num_sol(&generation, &gen_array_size, total_clauses, 
-                        total_literals, k, clauses_array, gen_num, temp);
-            //print_generation(generation, gen_array_size, gen_num);
+            if (gen_num_sol(segments, n_threads, total_clauses, 
+                            total_literals, k, clauses_array, temp, I_k, total_possible_soln)) {
+                verdict = 0;
+                break;
+            }
             //I_k -= num_soln_k_pairs;
             mpz_sub(I_k, I_k, temp);
             mpz_set_ui(temp, 0);
@@ -107,24 +131,22 @@ void sat_solver(DimacsInfo input){
             // here we underestimated so if it is equal to total_possible, then it is unsat
             //if (I_k == total_possible_soln) {
             if (mpz_cmp(I_k, total_possible_soln) == 0 ){
-                printf("unsat\n");
+                verdict = 0;
                 break;
             }
             // printf("at step %ld \n", k);
 
         }
-        gen_num++;
     }
     mpz_clear(temp);
+    // every generation was done without a check passing, I_k is exact by now
+    if (verdict == -1) verdict = mpz_cmp(I_k, total_possible_soln) < 0;
+
+    // free the last generation, its merged clauses are all in the arenas
+    segments_free(segments, 2 * n_threads);
+    free(segments);
+    free(masks);
 
-    // free the last generation
-    if (gen_num > 2) { // make sure not to free clauses of first gen ever!
-        free_clauses(&generation, gen_array_size); 
-    }
-    // we always free the gen array
-    free(generation);
-    
-    printf("outside loop \n");
     //printf("solutions to DNF: ");
     //mpz_out_str(stdout, 10, I_k);
     //printf("\n");
@@ -137,10 +159,209 @@ void sat_solver(DimacsInfo input){
     mpz_clear(I_k);
     
     
-    return;
+    return verdict;
 }
 
-int main(void) {
+bool sat_solver_dfs(DimacsInfo input){
+    // Same checks as sat_solver, but the k-subsets are counted by dfs_num_sol,
+    // which only keeps one path of merged clauses in memory instead of a whole
+    // generation. Each pass walks DFS_DEPTH_STEP more depths (redoing the
+    // shallower ones without counting them) and the checks are made once it
+    // is done, so it can go past the k where sat_solver would have stopped.
+    Clause *clauses_array = input.clauses;
+    unsigned long total_literals = input.numLiterals;
+    unsigned long total_clauses = input.numClauses;
+
+    mpz_t total_possible_soln;
+    mpz_init(total_possible_soln);
+    mpz_ui_pow_ui(total_possible_soln, 2, total_literals);
+    uint64_t *masks = clause_masks(clauses_array, total_clauses, total_literals);
+
+    // sums[k] is the number of solutions summed over the k-subsets
+    mpz_t *sums = malloc((total_clauses + 1) * sizeof(mpz_t));
+    for (unsigned long k = 0; k <= total_clauses; ++k) mpz_init(sums[k]);
+    mpz_t I_k;
+    mpz_init(I_k);
+
+    unsigned long done = 0; // depths already counted and checked
+    int verdict = -1; // sat or unsat once known
+    while (verdict == -1 && done < total_clauses) {
+        unsigned long to_k = done + DFS_DEPTH_STEP;
+        if (to_k > total_clauses) to_k = total_clauses;
+        dfs_num_sol(clauses_array, total_clauses, total_literals, done + 1, to_k, sums);
+        for (unsigned long k = done + 1; k <= to_k; ++k) {
+            if (k % 2 == 1) {
+                // here we over estimated so if it is less than the CNF is SAT
+                mpz_add(I_k, I_k, sums[k]);
+                if (mpz_cmp(I_k, total_possible_soln) < 0) {
+                    verdict = 1;
+                    break;
+                }
+            } else {
+                // here we underestimated so if it is equal to total_possible, then it is unsat
+                mpz_sub(I_k, I_k, sums[k]);
+                if (mpz_cmp(I_k, total_possible_soln) == 0) {
+                    verdict = 0;
+                    break;
+                }
+            }
+        }
+        done = to_k;
+    }
+
+    // every depth was done without a check passing, I_k is exact by now
+    if (verdict == -1) verdict = mpz_cmp(I_k, total_possible_soln) < 0;
+    for (unsigned long k = 0; k <= total_clauses; ++k) mpz_clear(sums[k]);
+    free(sums);
+    free(masks);
+    mpz_clear(I_k);
+    mpz_clear(total_possible_soln);
+    return verdict;
+}
+
+void count_models(DimacsInfo input, int n_threads, mpz_t count){
+    // Sets count to the number of assignments of all input.numLiterals
+    // variables that satisfy input. Goes through every generation, until
+    // there are no more merges without a conflict, so I_k ends up exact.
+    Clause *clauses_array = input.clauses;
+    unsigned long total_literals = input.numLiterals;
+    unsigned long total_clauses = input.numClauses;
+
+    GenSegment *segments = malloc(2 * n_threads * sizeof(GenSegment));
+    segments_init(segments, 2 * n_threads, 8 * total_clauses + 1, MERGE_DUPLICATES);
+    uint64_t *masks = clause_masks(clauses_array, total_clauses, total_literals);
+    mpz_t I_k, temp;
+    mpz_init(I_k);
+    mpz_init(temp);
+    populate_first_gen(&segments[0], clauses_array, total_literals, total_clauses, I_k);
+    for (unsigned long k = 2; k <= total_clauses; ++k) {
+        unsigned long gen_size = 0;
+        for (int t = 0; t < n_threads; ++t) gen_size += segments[t].size;
+        if (gen_size == 0) break;
+        gen_num_sol(segments, n_threads, total_clauses, total_literals, k, clauses_array, temp, NULL, NULL);
+        if (k % 2 == 1) mpz_add(I_k, I_k, temp);
+        else mpz_sub(I_k, I_k, temp);
+        mpz_set_ui(temp, 0);
+    }
+    mpz_ui_pow_ui(count, 2, total_literals);
+    mpz_sub(count, count, I_k);
+
+    segments_free(segments, 2 * n_threads);
+    free(segments);
+    free(masks);
+    mpz_clear(I_k);
+    mpz_clear(temp);
+}
+
+// The components of a formula, see split_components, for solve_components to
+// work through. They're handed out in order so the biggest start first.
+typedef struct ComponentJobs {
+    DimacsInfo *components;
+    unsigned long n;
+    unsigned long next;
+    int inner_threads;  // threads each component gets for gen_num_sol
+    bool depth_first;
+    mpz_t *counts;      // NULL unless counting models
+    int unsat;
+} ComponentJobs;
+
+void *solve_components(void *arg){
+    ComponentJobs *jobs = arg;
+    while (true) {
+        unsigned long c = __atomic_fetch_add(&jobs->next, 1, __ATOMIC_RELAXED);
+        if (c >= jobs->n) break;
+        if (jobs->counts) {
+            count_models(jobs->components[c], jobs->inner_threads, jobs->counts[c]);
+            continue;
+        }
+        // one unsat component is enough, the rest don't need solving
+        if (__atomic_load_n(&jobs->unsat, __ATOMIC_RELAXED)) break;
+        bool sat = jobs->depth_first ? sat_solver_dfs(jobs->components[c])
+                                     : sat_solver(jobs->components[c], jobs->inner_threads);
+        if (!sat) __atomic_store_n(&jobs->unsat, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+bool solve(DimacsInfo input, bool depth_first, mpz_t count){
+    /* Params:
+         input - formula to solve
+         depth_first - use sat_solver_dfs instead of sat_solver
+         count - if not NULL, set to the number of models of input
+       Return:
+         whether input is satisfiable
+
+       Inclusion-exclusion is exponential in the number of clauses, so the
+       formula is split into parts that share no variables and each is solved
+       on its own, several at a time. It's satisfiable iff they all are, and
+       its model count is the product of theirs.
+    */
+    DimacsInfo *components;
+    unsigned long *variables;
+    unsigned long n = split_components(input, &components, &variables);
+    // at least one, even with no components or --threads 0
+    unsigned long workers = NUM_THREADS > 1 ? (unsigned long) NUM_THREADS : 1;
+    if (n < workers) workers = n ? n : 1;
+    ComponentJobs jobs = {components, n, 0, NUM_THREADS / (int) workers, depth_first, NULL, 0};
+    if (count) {
+        jobs.counts = malloc((n + 1) * sizeof(mpz_t));
+        for (unsigned long c = 0; c < n; ++c) mpz_init(jobs.counts[c]);
+    }
+
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    for (unsigned long t = 1; t < workers; ++t) {
+        // not inside the assert, which -DNDEBUG drops
+        int rc = pthread_create(&threads[t], NULL, solve_components, &jobs);
+        assert(rc == 0);
+        (void) rc;
+    }
+    solve_components(&jobs);
+    for (unsigned long t = 1; t < workers; ++t) pthread_join(threads[t], NULL);
+    free(threads);
+
+    bool sat = !jobs.unsat;
+    if (count) {
+        // each component's count is over all the variables, only its own
+        // matter to it, and the ones in no clause can be anything
+        unsigned long free_variables = input.numLiterals;
+        mpz_set_ui(count, 1);
+        for (unsigned long c = 0; c < n; ++c) {
+            mpz_tdiv_q_2exp(jobs.counts[c], jobs.counts[c], input.numLiterals - variables[c]);
+            mpz_mul(count, count, jobs.counts[c]);
+            free_variables -= variables[c];
+            mpz_clear(jobs.counts[c]);
+        }
+        mpz_mul_2exp(count, count, free_variables);
+        free(jobs.counts);
+        sat = mpz_sgn(count) > 0;
+    }
+    for (unsigned long c = 0; c < n; ++c) free(components[c].clauses);
+    free(components);
+    free(variables);
+    return sat;
+}
+
+int main(int argc, char **argv) {
+    // --dfs counts with the depth first walk, for instances whose generations
+    // don't fit in memory. --count prints the number of models as well.
+    // --no-preprocess leaves the clauses as they are in the file.
+    // --merge-duplicates is for instances with a lot of symmetry. The formula
+    // is read from the file named, or stdin if there isn't one
+    bool depth_first = false;
+    bool counting = false;
+    bool cleanup = true;
+    const char *path = NULL;
+    NUM_THREADS = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--dfs")) depth_first = true;
+        else if (!strcmp(argv[i], "--count")) counting = true;
+        else if (!strcmp(argv[i], "--no-preprocess")) cleanup = false;
+        else if (!strcmp(argv[i], "--merge-duplicates")) MERGE_DUPLICATES = true;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) NUM_THREADS = atoi(argv[++i]);
+        else if (argv[i][0] != '-') path = argv[i];
+    }
+    if (NUM_THREADS < 1) NUM_THREADS = 1;
+
     ///manually create a DimacsInfo for testing purposes
     //Clause *clauses_array = basicTest(); // will be freed at the very end only!!
     // unsigned long numLiterals = 5;
@@ -152,29 +373,38 @@ int main(void) {
     // printClause(data.clauses + i);
     //}
     
-    DimacsInfo data =  parseDimacs();
+    DimacsInfo data =  parseDimacs(path);
+    if (cleanup) data = preprocess(data);
 
     Clause *clauses_array = data.clauses;
     //for (size_t i = 0; i < data.numClauses; ++i){
        // printClause(&clause_array[i]);
     //}
     
-    // Calculate the time taken by sat_solver()
-    clock_t t;
-    t = clock();
+    // Calculate the time taken by sat_solver(), wall clock since it can use
+    // several threads
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mpz_t count;
+    mpz_init(count);
     for(int i = 0; i < NUM_TRIALS; ++i){
-        sat_solver(data);
+        bool sat = solve(data, depth_first, counting ? count : NULL);
+        printf(sat ? "sat\n" : "unsat\n");
+        if (counting) {
+            printf("models: ");
+            mpz_out_str(stdout, 10, count);
+            printf("\n");
+        }
     }
-    t = clock() - t;
-    double time_taken = ((double)t)/CLOCKS_PER_SEC; // in seconds
+    mpz_clear(count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; // in seconds
  
     printf("sat_solver took %f seconds to execute on average \n", time_taken/NUM_TRIALS);
     
 
-    // now free the clause array
-    for (int i = 0; i < data.numClauses; ++i){
-       free(clauses_array[i].literals);
-    }
-    //free(clauses_array);
+    // now free the clause array, the literals are all in one block
+    free(data.literals);
+    free(clauses_array);
     return 0;
 }
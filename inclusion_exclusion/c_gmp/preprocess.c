@@ -0,0 +1,113 @@
+#include "satsolver.h"
+#include <string.h>
+
+static bool subsumes(Clause *a, Clause *b) {
+    // whether every literal of a is in b, both sorted without repeats
+    unsigned long j = 0;
+    for (unsigned long i = 0; i < a->numLiterals; i++) {
+        while (j < b->numLiterals && b->literals[j] < a->literals[i]) j++;
+        if (j == b->numLiterals || b->literals[j] != a->literals[i]) return false;
+        j++;
+    }
+    return true;
+}
+
+typedef struct ClauseOrder {
+    unsigned long conflicts;
+    unsigned long index;
+} ClauseOrder;
+
+static int compareOrder(const void *orderA, const void *orderB) {
+    // most conflicts first, file order between equals
+    const ClauseOrder *A = orderA, *B = orderB;
+    if (A->conflicts != B->conflicts) return A->conflicts > B->conflicts ? -1 : 1;
+    return A->index < B->index ? -1 : A->index > B->index;
+}
+
+/*
+ * Clean up a parsed formula before inclusion-exclusion (parseDimacs has
+ * already dropped repeated literals and clauses with x and -x):
+ *  - a clause with all the literals of another is dropped, whatever falsifies
+ *    it falsifies the smaller one too, so the union being counted is the same
+ *    (this covers duplicate clauses, only the first is kept)
+ * and then order the clauses by how many others they conflict with, most
+ * first. Which subsets survive a generation doesn't depend on the order, but
+ * each one is only extended with clauses after its last, so the fewer
+ * conflicts the later clauses have the less merging there is to try.
+ *
+ * Params:
+ *     input - parsed formula, its clauses are changed in place
+ * Return:
+ *     input with numClauses set to what's left
+ */
+DimacsInfo preprocess(DimacsInfo input) {
+    unsigned long m = input.numClauses, n = input.numLiterals;
+    Clause *clauses = input.clauses;
+    bool *dropped = calloc(m + 1, sizeof(bool));
+    assert(dropped != NULL);
+    for (unsigned long i = 0; i < m; i++) {
+        if (dropped[i]) continue;
+        for (unsigned long j = 0; j < m && !dropped[i]; j++) {
+            if (j == i || dropped[j] || clauses[j].numLiterals > clauses[i].numLiterals) continue;
+            // of two equal clauses the later one goes
+            if (clauses[j].numLiterals == clauses[i].numLiterals && j > i) continue;
+            if (subsumes(&clauses[j], &clauses[i])) dropped[i] = true;
+        }
+    }
+    unsigned long kept = 0;
+    for (unsigned long i = 0; i < m; i++) {
+        if (!dropped[i]) clauses[kept++] = clauses[i];
+    }
+    free(dropped);
+
+    // occurrences of literal l, as offsets into occurs, run from starts[l]
+    // to starts[l + 1]
+    unsigned long *starts = calloc(2 * n + 3, sizeof(unsigned long));
+    assert(starts != NULL);
+    for (unsigned long i = 0; i < kept; i++) {
+        for (unsigned long l = 0; l < clauses[i].numLiterals; l++) {
+            starts[clauses[i].literals[l] + 1]++;
+        }
+    }
+    for (unsigned long s = 1; s < 2 * n + 3; s++) starts[s] += starts[s - 1];
+    unsigned long *occurs = malloc((starts[2 * n + 2] + 1) * sizeof(unsigned long));
+    unsigned long *fill = malloc((2 * n + 3) * sizeof(unsigned long));
+    assert(occurs != NULL && fill != NULL);
+    memcpy(fill, starts, (2 * n + 3) * sizeof(unsigned long));
+    for (unsigned long i = 0; i < kept; i++) {
+        for (unsigned long l = 0; l < clauses[i].numLiterals; l++) {
+            occurs[fill[clauses[i].literals[l]]++] = i;
+        }
+    }
+
+    // a clause conflicts with each other clause that has one of its
+    // variables with the other sign, seen marks the ones already counted
+    ClauseOrder *order = malloc((kept + 1) * sizeof(ClauseOrder));
+    unsigned long *seen = calloc(kept + 1, sizeof(unsigned long));
+    assert(order != NULL && seen != NULL);
+    for (unsigned long i = 0; i < kept; i++) {
+        order[i] = (ClauseOrder){0, i};
+        for (unsigned long l = 0; l < clauses[i].numLiterals; l++) {
+            unsigned long opposite = clauses[i].literals[l] ^ 1;
+            for (unsigned long o = starts[opposite]; o < starts[opposite + 1]; o++) {
+                if (seen[occurs[o]] == i + 1) continue;
+                seen[occurs[o]] = i + 1;
+                order[i].conflicts++;
+            }
+        }
+    }
+    qsort(order, kept, sizeof(ClauseOrder), compareOrder);
+    Clause *sorted = malloc((kept + 1) * sizeof(Clause));
+    assert(sorted != NULL);
+    for (unsigned long i = 0; i < kept; i++) sorted[i] = clauses[order[i].index];
+    memcpy(clauses, sorted, kept * sizeof(Clause));
+
+    free(sorted);
+    free(order);
+    free(seen);
+    free(starts);
+    free(occurs);
+    free(fill);
+    input.numClauses = kept;
+    return input;
+}
@@ -10,6 +10,15 @@ Bignum createBignum() {
     return num;
 }
 
+Bignum copyBignum(Bignum *num) {
+    Bignum copy = {NULL, num->n_words, num->sign};
+    if (num->n_words) {
+        copy.words = malloc(num->n_words * sizeof(num->words[0]));
+        memcpy(copy.words, num->words, num->n_words * sizeof(num->words[0]));
+    }
+    return copy;
+}
+
 
 int print_binary(Bignum *num) {
     unsigned saw_first_one = 0;
@@ -54,6 +63,19 @@ void add(unsigned power, Bignum *num) {
       else cascade_up(word_idx, bit, num);
 }
 
+void add_multiple(unsigned power, uint64_t count, Bignum *num) {
+    // adds count * 2^power, one shifted add per set bit of count
+    for (unsigned b = 0; count; b++, count >>= 1) {
+        if (count & 1) add(power + b, num);
+    }
+}
+
+void sub_multiple(unsigned power, uint64_t count, Bignum *num) {
+    for (unsigned b = 0; count; b++, count >>= 1) {
+        if (count & 1) sub(power + b, num);
+    }
+}
+
 void sub(unsigned power, Bignum *num) {
     unsigned word_idx = power / 64;
     uint64_t bit = ((uint64_t)1 << (uint64_t)(power % 64));
@@ -1,4 +1,8 @@
 #include "satsolver.h"
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 
 Clause createClause(unsigned long *vals,  bool *signs, unsigned long numLits) {
@@ -9,65 +13,294 @@ Clause createClause(unsigned long *vals,  bool *signs, unsigned long numLits) {
     Return:
         CLause struct containing the data for this clause
 */
-    Clause clause = {NULL, 0};  // Defaults to empty clause  
+    Clause clause = {.literals = NULL, .numLiterals = 0, .masks = NULL, .compatible = NULL};  // Defaults to empty clause  
     clause.literals = malloc(sizeof(Literal)*numLits);
     assert(clause.literals);
-    // create literal struct and insert in array
+    // pack each literal and insert in array
     for (int i = 0; i < numLits; i++) {
-        Literal newLit = {vals[i], signs[i]};
-	    clause.literals[i] = newLit;
+        clause.literals[i] = make_literal(vals[i], signs[i]);
     } 
     clause.numLiterals = numLits;
     return clause;
 }
 
-Clause* merge(Clause *clause1, Clause *clause2) {
+void arena_init(LiteralArena *arena, size_t capacity) {
+/*  Params:
+        arena - arena to set up
+        capacity - number of literals to make room for up front
+*/
+    arena->literals = malloc(sizeof(Literal) * capacity);
+    assert(arena->literals);
+    arena->used = 0;
+    arena->capacity = capacity;
+    arena->words = malloc(sizeof(uint64_t) * capacity);
+    assert(arena->words);
+    arena->words_used = 0;
+    arena->words_capacity = capacity;
+}
+
+void arena_reset(LiteralArena *arena) {
+    // everything in the arena is released at once, the memory is kept for
+    // the next generation
+    arena->used = 0;
+    arena->words_used = 0;
+}
+
+void arena_free(LiteralArena *arena) {
+    free(arena->literals);
+    free(arena->words);
+    arena->literals = NULL;
+    arena->words = NULL;
+    arena->used = arena->capacity = 0;
+    arena->words_used = arena->words_capacity = 0;
+}
+
+static void arena_reserve(LiteralArena *arena, size_t n) {
+    // makes room for n more literals, the buffer may move
+    if (arena->used + n <= arena->capacity) return;
+    while (arena->used + n > arena->capacity) arena->capacity *= 2;
+    arena->literals = realloc(arena->literals, sizeof(Literal) * arena->capacity);
+    assert(arena->literals);
+}
+
+static uint64_t *arena_reserve_words(LiteralArena *arena, size_t n) {
+    // makes room for n more words and returns where they go, without
+    // claiming them
+    if (arena->words_used + n > arena->words_capacity) {
+        while (arena->words_used + n > arena->words_capacity) arena->words_capacity *= 2;
+        arena->words = realloc(arena->words, sizeof(uint64_t) * arena->words_capacity);
+        assert(arena->words);
+    }
+    return arena->words + arena->words_used;
+}
+
+size_t arena_push(LiteralArena *arena, Literal *literals, unsigned long numLiterals) {
+/*  Params:
+        arena - arena to copy into
+        literals - literals to copy
+        numLiterals - how many there are
+    Return:
+        offset of the copy in the arena
+*/
+    arena_reserve(arena, numLiterals);
+    size_t offset = arena->used;
+    for (unsigned long i = 0; i < numLiterals; i++) arena->literals[offset + i] = literals[i];
+    arena->used += numLiterals;
+    return offset;
+}
+
+long merge(Literal *literals1, unsigned long numLiterals1, Literal *literals2, unsigned long numLiterals2,
+           LiteralArena *arena, size_t *offset) {
     /* Params:
-         clause1 - pointer to first clause struct being merged
-         clause2 - pointer to second clause struct being merged
+         literals1, numLiterals1 - first clause being merged, sorted
+         literals2, numLiterals2 - second clause being merged, sorted
+         arena - where the merged clause goes
+         offset - set to the merged clause's offset in the arena
        Return:
-         pointer to a heap allocated clause struct or NULL if there was a conflict
+         number of literals in the merged clause, or -1 if there was a conflict,
+         in which case nothing is left in the arena
+
+       Neither clause may point into arena itself, since reserving space can
+       move it.
     */
     // ensures enough space for union of the clauses
-	unsigned long maxSize = clause1->numLiterals + clause2->numLiterals;
-	Literal* newLiterals = malloc(sizeof(Literal) * maxSize);
-	assert(newLiterals);
+    arena_reserve(arena, numLiterals1 + numLiterals2);
+    Literal *newLiterals = arena->literals + arena->used;
     // track our place within the merge function
-	unsigned long clause1idx = 0, clause2idx = 0, newClauseSize = 0;
-	Literal* lastAdded = NULL; // will allow us to detect potential conflicts later
-    // iterate over ALL literals
-	while(clause1idx < clause1->numLiterals || clause2idx < clause2->numLiterals) {
-		Literal* next;
-        // The next literal to be added is one of least value  
-		if (clause1idx < clause1->numLiterals && clause2idx < clause2->numLiterals) {  
-			next = clause1->literals[clause1idx].value < clause2->literals[clause2idx].value 
-            ? clause1->literals + clause1idx : clause2->literals + clause2idx;
-		} 
-		else if (clause1idx == clause1->numLiterals) next = clause2->literals + clause2idx;
-	    else next = clause1->literals + clause1idx;	
-        // check for conflict
-		if (lastAdded && (next->value == lastAdded->value)) { 
-            // clean up memory, no clause returned because of conflict
-			if (next->sign != lastAdded->sign) {
-				free(newLiterals); 
-				return NULL;
-			}
+    unsigned long clause1idx = 0, clause2idx = 0, newClauseSize = 0;
+    // iterate over ALL literals, the next one added is the one of least value
+    while (clause1idx < numLiterals1 || clause2idx < numLiterals2) {
+        Literal next;
+        if (clause2idx == numLiterals2 ||
+            (clause1idx < numLiterals1 && literals1[clause1idx] < literals2[clause2idx])) {
+            next = literals1[clause1idx++];
+        } else {
+            next = literals2[clause2idx++];
+        }
+        // check for conflict against the last literal added
+        if (newClauseSize && (next | 1) == (newLiterals[newClauseSize - 1] | 1)) {
+            // no clause returned because of conflict, the space just isn't claimed
+            if (next != newLiterals[newClauseSize - 1]) return -1;
             // skip repeat literal
-			if (next == clause1->literals + clause1idx) clause1idx++;
-			else clause2idx++;
-		} else {
-		 newLiterals[newClauseSize] = *next;
-		 newClauseSize++;
-		 lastAdded = next;
-		}
-        // increments past the newly added literal (might be able to do this earlier by the ternary assignment )
-		if (lastAdded == clause1->literals + clause1idx) clause1idx = clause1idx < clause1->numLiterals ? clause1idx + 1 : clause1idx;
-		if (lastAdded == clause2->literals + clause2idx) clause2idx = clause2idx < clause2->numLiterals ? clause2idx + 1 : clause2idx;
-	}
-	Clause result = {realloc(newLiterals, sizeof(Literal) * newClauseSize), newClauseSize};
-    assert(result.literals);
-    Clause *savedClause = malloc(sizeof(Clause));
-    assert(savedClause);
-    *savedClause = result;
-	return savedClause;
+            continue;
+        }
+        newLiterals[newClauseSize++] = next;
+    }
+    *offset = arena->used;
+    arena->used += newClauseSize;
+    return newClauseSize;
+}
+
+size_t mask_words(unsigned long total_literals) {
+    // literal values run from 1 to total_literals, bit v is literal v
+    return total_literals / 64 + 1;
+}
+
+bool use_dense(unsigned long numLiterals, unsigned long total_literals) {
+    return numLiterals > total_literals / DENSE_DIVISOR;
+}
+
+static void to_masks(Literal *literals, unsigned long numLiterals, uint64_t *masks, size_t words) {
+    // positive mask in the first words, negative in the next
+    memset(masks, 0, sizeof(uint64_t) * 2 * words);
+    for (unsigned long i = 0; i < numLiterals; i++) {
+        unsigned long v = literal_value(literals[i]);
+        masks[(literal_sign(literals[i]) ? 0 : words) + v / 64] |= (uint64_t)1 << (v % 64);
+    }
+}
+
+size_t compatible_words(unsigned long total_clauses) {
+    // bit j is clause j
+    return total_clauses / 64 + 1;
+}
+
+static bool conflicts(const uint64_t *a, const uint64_t *b, size_t words) {
+    // whether a and b, dense clauses, have some literal with opposite signs
+    uint64_t conflict_bits = 0;
+    for (size_t i = 0; i < words; i++) conflict_bits |= (a[i] & b[words + i]) | (a[words + i] & b[i]);
+    return conflict_bits != 0;
+}
+
+uint64_t *clause_masks(Clause *clauses, unsigned long numClauses, unsigned long total_literals) {
+/*  Params:
+        clauses - clauses to give a dense form, their masks and compatible
+                  rows get set
+        numClauses, total_literals - from the DimacsInfo
+    Return:
+        the block all of the masks live in, to be freed once they're done with
+
+    A subset of clauses merges without a conflict exactly when every pair of
+    them does, so the rows are all gen_num_sol needs to know which merges to
+    try. A row only has the clauses after its own, those are the only ones a
+    subset ending in it gets extended with.
+*/
+    size_t words = mask_words(total_literals);
+    size_t row_words = compatible_words(numClauses);
+    uint64_t *masks = malloc(sizeof(uint64_t) * (2 * words + row_words) * (numClauses + 1));
+    assert(masks);
+    uint64_t *rows = masks + 2 * words * numClauses;
+    memset(rows, 0, sizeof(uint64_t) * row_words * numClauses);
+    for (unsigned long i = 0; i < numClauses; i++) {
+        clauses[i].masks = masks + 2 * words * i;
+        clauses[i].compatible = rows + row_words * i;
+        to_masks(clauses[i].literals, clauses[i].numLiterals, clauses[i].masks, words);
+    }
+    for (unsigned long i = 0; i < numClauses; i++) {
+        // a clause with x and -x conflicts with everything, itself included
+        if (conflicts(clauses[i].masks, clauses[i].masks, words)) continue;
+        for (unsigned long j = i + 1; j < numClauses; j++) {
+            if (conflicts(clauses[i].masks, clauses[j].masks, words) ||
+                conflicts(clauses[j].masks, clauses[j].masks, words)) continue;
+            clauses[i].compatible[j / 64] |= (uint64_t)1 << (j % 64);
+        }
+    }
+    return masks;
+}
+
+size_t arena_push_masks(LiteralArena *arena, uint64_t *masks, size_t words) {
+    uint64_t *out = arena_reserve_words(arena, 2 * words);
+    memcpy(out, masks, sizeof(uint64_t) * 2 * words);
+    size_t offset = arena->words_used;
+    arena->words_used += 2 * words;
+    return offset;
+}
+
+unsigned long arena_push_compatible(LiteralArena *arena, const uint64_t *parent, unsigned long parent_last,
+                                    Clause *clause, unsigned long clause_num, unsigned long total_clauses,
+                                    size_t *offset) {
+/*  Params:
+        arena - where the child's set goes
+        parent - the clauses after parent_last that merge with all of the
+                 parent's, as words (parent_last + 1) / 64 on of the bitset
+        clause, clause_num - the clause the parent is extended with, after
+                             parent_last
+        offset - set to where the child's set went
+    Return:
+        how many clauses the child can take. If none nothing is pushed, it
+        has no children and doesn't need keeping
+
+    The child's set is the parent's and clause's row together, kept from
+    word (clause_num + 1) / 64 on like the parent's.
+*/
+    size_t words = compatible_words(total_clauses);
+    size_t from = (clause_num + 1) / 64, skip = from - (parent_last + 1) / 64;
+    uint64_t *out = arena_reserve_words(arena, words - from);
+    unsigned long count = 0;
+    for (size_t i = from; i < words; i++) {
+        // the row has nothing at or before clause_num, so neither does this
+        out[i - from] = parent[skip + i - from] & clause->compatible[i];
+        count += __builtin_popcountll(out[i - from]);
+    }
+    if (!count) return 0;
+    *offset = arena->words_used;
+    arena->words_used += words - from;
+    return count;
+}
+
+static long merge_masks(const uint64_t *a, const uint64_t *b, uint64_t *out, size_t words) {
+    /* Params:
+         a, b - dense clauses, words words of positive mask then as many negative
+         out - where the merged clause goes
+       Return:
+         number of literals in the merged clause, or -1 if some literal shows
+         up with both signs
+    */
+    size_t i = 0;
+#ifdef __AVX2__
+    __m256i conflict = _mm256_setzero_si256();
+    for (; i + 4 <= words; i += 4) {
+        __m256i pos = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                      _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i neg = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(a + words + i)),
+                                      _mm256_loadu_si256((const __m256i *)(b + words + i)));
+        conflict = _mm256_or_si256(conflict, _mm256_and_si256(pos, neg));
+        _mm256_storeu_si256((__m256i *)(out + i), pos);
+        _mm256_storeu_si256((__m256i *)(out + words + i), neg);
+    }
+    if (!_mm256_testz_si256(conflict, conflict)) return -1;
+#endif
+    uint64_t conflict_bits = 0;
+    for (; i < words; i++) {
+        out[i] = a[i] | b[i];
+        out[words + i] = a[words + i] | b[words + i];
+        conflict_bits |= out[i] & out[words + i];
+    }
+    if (conflict_bits) return -1;
+    long count = 0;
+    for (i = 0; i < 2 * words; i++) count += __builtin_popcountll(out[i]);
+    return count;
+}
+
+long merge_child(Clause *clause, GenChild *child, LiteralArena *from, LiteralArena *to,
+                 unsigned long total_literals, size_t *offset, bool *dense) {
+    /* Params:
+         clause - input clause, with its masks set
+         child - generation entry whose merged clause is in from
+         to - where the merged clause goes
+         offset, dense - set to where it went
+       Return:
+         number of literals in the merged clause, or -1 if there was a conflict
+
+       Merges in whichever form child is in. Sparse results that get past
+       the switch point are converted, so a clause never goes back to sparse.
+    */
+    size_t words = mask_words(total_literals);
+    if (child->dense) {
+        long n = merge_masks(clause->masks, from->words + child->offset, arena_reserve_words(to, 2 * words), words);
+        if (n < 0) return -1;
+        *offset = to->words_used;
+        *dense = true;
+        to->words_used += 2 * words;
+        return n;
+    }
+    long n = merge(clause->literals, clause->numLiterals, from->literals + child->offset, child->numLiterals, to, offset);
+    *dense = false;
+    if (n < 0 || !use_dense(n, total_literals)) return n;
+    // it was the last thing pushed, so its space can be handed back
+    to_masks(to->literals + *offset, n, arena_reserve_words(to, 2 * words), words);
+    to->used -= n;
+    *offset = to->words_used;
+    *dense = true;
+    to->words_used += 2 * words;
+    return n;
 }
@@ -1,52 +1,63 @@
 #include "satsolver.h"
-
-#define  DEFAULT_CLAUSE_SIZE 8
+#include "../dimacs.h"
 
 int compareLiterals(const void* literalA, const void* literalB) {
-    Literal *A = (Literal*) literalA;
-    Literal *B = (Literal*) literalB;
-    return A->value - B->value;
+    Literal A = *(Literal*) literalA;
+    Literal B = *(Literal*) literalB;
+    return (A > B) - (A < B);
 }
 
-DimacsInfo parseDimacs(void) {
-    /*
-        Matthew's parser implementation was referenced when writing this parser.
+static bool tidy_clause(Clause *clause) {
+    /* Params:
+         clause - sorted, gets its repeated literals dropped
+       Return:
+         whether it has a literal with both signs, it's always true then
     */
-    // Read comment lines at the start.
-    for (char c; (c = getc(stdin)) == 'c';)
-        while (getc(stdin) != '\n');
-
-    unsigned long numLiterals, numClauses;
-    // Read in number of literals and clauses
-        assert(scanf(" cnf %lu %lu\n", &numLiterals, &numClauses) == 2);
-        //N_VARS++; why???
-        Clause *clauses = malloc(sizeof(Clause) * numClauses);
-        assert(clauses);
+    unsigned long size = 0;
+    for (unsigned long i = 0; i < clause->numLiterals; i++) {
+        Literal next = clause->literals[i];
+        // -x sorts right before x, so either would be the last one kept
+        if (size && clause->literals[size - 1] == next) continue;
+        if (size && (clause->literals[size - 1] ^ 1) == next) return true;
+        clause->literals[size++] = next;
+    }
+    clause->numLiterals = size;
+    return false;
+}
 
-        for (size_t i = 0; i < numClauses; i++) {
-            Clause clause;
-            size_t max = DEFAULT_CLAUSE_SIZE;
-            size_t trueSize = 0;
-            clause.literals = malloc(sizeof(Literal) * DEFAULT_CLAUSE_SIZE);
+DimacsInfo parseDimacs(const char *path) {
+    /* Params:
+         path - DIMACS file to read, NULL for stdin
+       Return:
+         the formula, each clause sorted (see Literal) without repeated
+         literals, and clauses with x and -x left out since nothing falsifies
+         them. Every clause then has at most numLiterals literals, which the
+         solution counts rely on. The clauses' literals are all in one block,
+         input.literals, so they're freed together
 
-            int literal = 0;
-            for (assert(scanf("%d ", &literal)); literal; assert(scanf("%d ", &literal))) {
-                int val = literal < 0 ? literal * -1 : literal;
-                bool sign = literal > 0;
-                Literal literal = {val, sign};
-                clause.literals[trueSize] = literal;
-                trueSize++;
-                if (trueSize == max) {
-                    max *= 2;
-                    clause.literals = realloc(clause.literals, sizeof(Literal) * max);
-                }
-            }
-            clause.literals = realloc(clause.literals, sizeof(Literal) * trueSize);
-            clause.numLiterals = trueSize;
-            qsort(clause.literals, clause.numLiterals, sizeof(Literal), compareLiterals);
-            clauses[i] = clause;
+       Reading is done by the loader in dimacs.h, shared with the other C
+       solvers, this only converts its literals.
+    */
+    DimacsCnf cnf;
+    if (!dimacs_read(path, &cnf)) {
+        fprintf(stderr, "could not read a DIMACS CNF from %s\n", path ? path : "stdin");
+        exit(1);
+    }
+    Clause *clauses = malloc((cnf.numClauses + 1) * sizeof(Clause));
+    Literal *literals = malloc((cnf.starts[cnf.numClauses] + 1) * sizeof(Literal));
+    assert(clauses && literals);
+    unsigned long kept = 0;
+    for (unsigned long i = 0; i < cnf.numClauses; i++) {
+        Clause clause = {literals + cnf.starts[i], cnf.starts[i + 1] - cnf.starts[i], NULL, NULL};
+        for (unsigned long l = 0; l < clause.numLiterals; l++) {
+            int literal = cnf.literals[cnf.starts[i] + l];
+            clause.literals[l] = make_literal(literal < 0 ? -literal : literal, literal > 0);
         }
-    DimacsInfo parseData = {clauses, numLiterals, numClauses};
+        qsort(clause.literals, clause.numLiterals, sizeof(Literal), compareLiterals);
+        if (!tidy_clause(&clause)) clauses[kept++] = clause;
+    }
+    DimacsInfo parseData = {clauses, cnf.numVariables, kept, literals};
+    dimacs_free(&cnf);
     return parseData;
 }
 
@@ -55,8 +66,8 @@ void printClause(Clause *clause) {
     unsigned long numLits = clause ? clause->numLiterals : 0;
 	printf("Number of Literals: %lu \n", numLits);
 	for (unsigned long i = 0; i < numLits; i++) {
-        if (clause->literals[i].sign) printf("-");
-	    printf("%lu ", clause->literals[i].value);
+        if (!literal_sign(clause->literals[i])) printf("-");
+	    printf("%lu ", literal_value(clause->literals[i]));
 	}
 	printf("\n");
 }
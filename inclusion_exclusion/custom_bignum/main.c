@@ -1,4 +1,13 @@
 #include "satsolver.h"
+#include <string.h>
+#include <unistd.h>
+
+// threads gen_num_sol expands each generation with, --threads N, defaults to
+// one per core
+int NUM_THREADS = 1;
+// --merge-duplicates, keep one entry per distinct merged clause in each
+// generation, see keep_child
+bool MERGE_DUPLICATES = false;
 
 
 Clause *basicTest(){
@@ -47,11 +56,13 @@ void sat_solver(DimacsInfo input){
 	
     //unsigned long total_possible_soln_pow = total_literals; 
 
-    // first generation will have (# of clauses) GenChilds
-    unsigned long gen_array_size = total_clauses;
-    GenChild *generation = malloc(gen_array_size * sizeof(GenChild));
+    // the current generation and the one being built, NUM_THREADS segments each
+    GenSegment *segments = malloc(2 * NUM_THREADS * sizeof(GenSegment));
+    segments_init(segments, 2 * NUM_THREADS, 8 * total_clauses + 1, MERGE_DUPLICATES);
+    clause_masks(clauses_array, total_clauses, total_literals);
     Bignum I_k = createBignum();
-    populate_first_gen(&generation, clauses_array, total_literals, total_clauses, &I_k);
+    // first generation will have (# of clauses) GenChilds
+    populate_first_gen(&segments[0], clauses_array, total_literals, total_clauses, &I_k);
     //print_generation(generation, gen_array_size, 1);
     if (isLessThanPower(total_literals, &I_k)) {
         printf("sat\n");
@@ -59,13 +70,11 @@ void sat_solver(DimacsInfo input){
     }
     
     //unsigned long I_k = first_gen_soln;
-    int gen_num = 2;
-    
     for (size_t k = 2; k <= total_clauses; ++k){
-         gen_num_sol(&generation, &gen_array_size, total_clauses, 
-                      total_literals, k, clauses_array, gen_num, &I_k);
-            //print_generation(generation, gen_array_size, gen_num);
-        int isLess = isLessThanPower(total_literals, &I_k);
+         bool early = gen_num_sol(segments, NUM_THREADS, total_clauses, 
+                                  total_literals, k, clauses_array, &I_k);
+        // decided part way through the generation, I_k is only partly updated
+        int isLess = early ? k % 2 == 1 : isLessThanPower(total_literals, &I_k);
         // at the odd step
         
         if (k % 2 == 1) {
@@ -82,7 +91,6 @@ void sat_solver(DimacsInfo input){
                 return;
             }
         }
-        gen_num++;
     }
     // obviously we never come here, this was when I was testing gen by gen
     printf("Number of solutions:  ");
@@ -92,12 +100,22 @@ void sat_solver(DimacsInfo input){
     return;
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    // the formula is read from the file named, or stdin if there isn't one
+    const char *path = NULL;
+    NUM_THREADS = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) NUM_THREADS = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--merge-duplicates")) MERGE_DUPLICATES = true;
+        else if (argv[i][0] != '-') path = argv[i];
+    }
+    if (NUM_THREADS < 1) NUM_THREADS = 1;
+
     // manually create a DimacsInfo for testing purposes
     Clause *clauses_array = basicTest(); // will be freed at the very end only!!
     unsigned long numLiterals = 5;
 	unsigned long numClauses = 4;
-	DimacsInfo data = parseDimacs(); //{clauses_array, numLiterals, numClauses};
+	DimacsInfo data = parseDimacs(path); //{clauses_array, numLiterals, numClauses};
 	// print the Dimacs
 	//printf("printing DimacsInfo: \n");
 	for (size_t i = 0; i < data.numClauses; i++) {
@@ -16,48 +16,123 @@ typedef struct Bignum {
     int sign;
 } Bignum;
 
-typedef struct Literal {
-    unsigned long value;
-    bool sign;
-} Literal;
+// A literal packed as 2 * variable + sign, sign being 1 for a positive one.
+// Sorted by this, a clause is sorted by variable and x, -x end up next to each
+// other, so merging and conflict checks compare literals as plain integers.
+typedef uint32_t Literal;
+
+static inline Literal make_literal(unsigned long value, bool sign) {
+    return 2 * value + sign;
+}
+
+static inline unsigned long literal_value(Literal literal) {
+    return literal >> 1;
+}
+
+static inline bool literal_sign(Literal literal) {
+    return literal & 1;
+}
 
 typedef struct Clause {
     Literal *literals;  // array of literals
     unsigned long numLiterals;    
+    uint64_t *masks;    // dense form, see clause_masks
+    uint64_t *compatible;   // bit j set for each later clause j it merges with
 } Clause;
 
 typedef struct DimacsInfo {
 	Clause* clauses;
 	unsigned long numLiterals;
 	unsigned long numClauses;
+    Literal *literals;  // the block every clause's literals are in, see parseDimacs
 } DimacsInfo; 
 
+// Bump allocator for the merged clauses of one generation. Literals are laid
+// out back to back and released all at once with arena_reset. The buffer can
+// move when it grows, so clauses in it are referred to by offset. Dense
+// clauses go in words instead, see merge_child.
+typedef struct LiteralArena {
+    Literal *literals;
+    size_t used;
+    size_t capacity;
+    uint64_t *words;
+    size_t words_used;
+    size_t words_capacity;
+} LiteralArena;
+
 typedef struct GenChild {
     unsigned long last_clause_num;
     unsigned long num_sol; // STORE POWER INSTEAD
-    Clause *merged_clause;
+    size_t offset;              // merged clause, in the generation's arena
+    unsigned long numLiterals;
+    bool dense;                 // offset is into the arena's words
+    unsigned int later;         // how many clauses it can still be extended with
+    size_t compatible;          // later clauses that merge with all of the
+                                // child's, in the arena's words, see
+                                // arena_push_compatible
+    uint64_t count;             // how many subsets it stands for, see keep_child
 } GenChild;
 
+// One thread's share of a generation, see gen_num_sol. Its merged clauses
+// are in its own arena so no two threads ever write to the same one.
+typedef struct GenSegment {
+    GenChild *children;
+    unsigned long size;
+    unsigned long capacity;
+    LiteralArena arena;
+    uint64_t *slots;            // hash table of children, see keep_child, or NULL
+    size_t slot_count;          // a power of two, at least twice size
+} GenSegment;
+
+// A clause is kept as a sorted literal array until it has more than
+// total_literals / DENSE_DIVISOR literals, then as a positive and a negative
+// bitmask. k packed literals take 4k bytes and the masks about
+// total_literals / 4, so past total_literals / 16 the masks are smaller as
+// well as faster to merge. prototype_solver's AdaClause switches at / 640,
+// which was worked out for its own literals.
+#ifndef DENSE_DIVISOR
+#define DENSE_DIVISOR 16
+#endif
+
 // functions in cleanParse
-DimacsInfo parseDimacs(void);
+DimacsInfo parseDimacs(const char *path);
 void printClause(Clause *clause);
 
 // functions in cleanMerge
 Clause createClause(unsigned long *vals,  bool *signs, unsigned long numLits);
-Clause* merge(Clause *clause1, Clause *clause2);
+void arena_init(LiteralArena *arena, size_t capacity);
+void arena_reset(LiteralArena *arena);
+void arena_free(LiteralArena *arena);
+size_t arena_push(LiteralArena *arena, Literal *literals, unsigned long numLiterals);
+long merge(Literal *literals1, unsigned long numLiterals1, Literal *literals2, unsigned long numLiterals2,
+           LiteralArena *arena, size_t *offset);
+size_t mask_words(unsigned long total_literals);
+bool use_dense(unsigned long numLiterals, unsigned long total_literals);
+uint64_t *clause_masks(Clause *clauses, unsigned long numClauses, unsigned long total_literals);
+size_t arena_push_masks(LiteralArena *arena, uint64_t *masks, size_t words);
+size_t compatible_words(unsigned long total_clauses);
+unsigned long arena_push_compatible(LiteralArena *arena, const uint64_t *parent, unsigned long parent_last,
+                                    Clause *clause, unsigned long clause_num, unsigned long total_clauses,
+                                    size_t *offset);
+long merge_child(Clause *clause, GenChild *child, LiteralArena *from, LiteralArena *to,
+                 unsigned long total_literals, size_t *offset, bool *dense);
 
 // functions in gen_pairing_sol
 unsigned long gen_size(unsigned long k, unsigned long total_clauses);
-unsigned long count_power(Clause *clause, unsigned long total_literals);
-void free_clauses(GenChild **prev_generation, unsigned long prev_gen_size);
-void gen_num_sol(GenChild **prev_generation, unsigned long *array_size, unsigned long total_clauses, 
-                unsigned long total_literals, unsigned long k, Clause* clauses, int gen_num, Bignum *solution_count);
-void populate_first_gen(GenChild **generations, Clause *clauses, unsigned long total_literals, 
+unsigned long count_power(unsigned long numLiterals, unsigned long total_literals);
+void fold_histogram(uint64_t *hist, unsigned long total_literals, int shouldAdd, Bignum *solution_count);
+bool gen_num_sol(GenSegment *segments, int n_threads, unsigned long total_clauses,
+                 unsigned long total_literals, unsigned long k, Clause* clauses, Bignum *solution_count);
+void segments_init(GenSegment *segments, int n, size_t arena_capacity, bool merge_duplicates);
+void segments_free(GenSegment *segments, int n);
+void populate_first_gen(GenSegment *segment, Clause *clauses, unsigned long total_literals, 
                                  unsigned long total_clauses, Bignum *solution_count);
 
 
 Bignum createBignum();
 
+Bignum copyBignum(Bignum *num);
+
 int print_binary(Bignum *num);
 
 int print_hex(Bignum *num);
@@ -68,10 +143,14 @@ void add(unsigned power, Bignum *num);
 
 void sub(unsigned power, Bignum *num);
 
+void add_multiple(unsigned power, uint64_t count, Bignum *num);
+
+void sub_multiple(unsigned power, uint64_t count, Bignum *num);
+
 void cascade_up(unsigned idx, uint64_t bit, Bignum *num);
 
 void cascade_down(unsigned idx, uint64_t bit, Bignum *num);
 
 
 
-#endif 
\ No newline at end of file
+#endif 
\ No newline at end of file
@@ -0,0 +1,264 @@
+/*
+DIMACS CNF loader shared by the C solvers (c_gmp, custom_bignum and
+matthew_chaff). The input is mapped rather than read through stdio, numbers
+are scanned by hand, and every clause ends up in one array of literals:
+
+    DimacsCnf cnf;
+    if (!dimacs_read(path, &cnf)) ...       // path NULL for stdin
+    for (unsigned long i = 0; i < cnf.numClauses; i++)
+        for (size_t l = cnf.starts[i]; l < cnf.starts[i + 1]; l++)
+            ... cnf.literals[l] ...         // v or -v, as in the file
+    dimacs_free(&cnf);
+
+The body is parsed twice, once to count the literals and clauses and once to
+fill them in where the counts say they go. Inputs over DIMACS_CHUNK_BYTES are
+cut into chunks at line starts and each pass does the chunks in parallel, so
+the solvers that include this need -pthread.
+
+Lines starting with c are comments wherever they are, and a line starting with
+% ends the formula (SATLIB files have one). Clauses past the count on the p
+line are ignored, as are literals after the last 0. A variable past the count
+on the p line makes the whole file unreadable, the solvers size everything by
+that count.
+*/
+
+#ifndef DIMACS_H
+#define DIMACS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the parsed formula, clause i is literals[starts[i]] up to literals[starts[i + 1]]
+typedef struct DimacsCnf {
+    unsigned long numVariables;
+    unsigned long numClauses;
+    int *literals;
+    size_t *starts;
+} DimacsCnf;
+
+// inputs are split so each thread gets at least this much of the body
+#define DIMACS_CHUNK_BYTES (4 << 20)
+
+// one thread's share of the body, see dimacs_scan
+typedef struct DimacsChunk {
+    const char *begin, *end;
+    size_t literals;        // counted in the first pass
+    size_t clauses;
+    long max_variable;      // largest variable, also from the first pass
+    bool stop;              // has the % line
+    size_t literal_at;      // where its first literal and clause go, for the
+    size_t clause_at;       // second pass
+    DimacsCnf *cnf;         // NULL in the first pass
+} DimacsChunk;
+
+static const char *dimacs_skip_line(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p < end ? p + 1 : end;
+}
+
+static bool dimacs_at_number(const char *p, const char *end) {
+    if (p < end && *p == '-') p++;
+    return p < end && *p >= '0' && *p <= '9';
+}
+
+static const char *dimacs_number(const char *p, const char *end, long *value) {
+    // reads the integer at p, see dimacs_at_number, returns where it stops
+    bool negative = *p == '-';
+    if (negative) p++;
+    long v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) v = 10 * v + (*p - '0');
+    *value = negative ? -v : v;
+    return p;
+}
+
+static void *dimacs_scan(void *arg) {
+    /* Params:
+         arg - a DimacsChunk starting at a line start. Without a cnf its
+               literals and clauses get counted, with one they're written
+               from literal_at and clause_at on
+    */
+    DimacsChunk *chunk = arg;
+    size_t literal = chunk->literal_at, clause = chunk->clause_at;
+    const char *p = chunk->begin, *end = chunk->end;
+    while (p < end) {
+        // at a line start
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == end) break;
+        if (*p == 'c' || *p == 'p') {
+            p = dimacs_skip_line(p, end);
+            continue;
+        }
+        if (*p == '%') {
+            chunk->stop = true;
+            break;
+        }
+        while (p < end && *p != '\n') {
+            if (!dimacs_at_number(p, end)) {
+                // whitespace, or something that isn't DIMACS
+                p++;
+                continue;
+            }
+            long v;
+            p = dimacs_number(p, end, &v);
+            if (v) {
+                if (chunk->cnf) chunk->cnf->literals[literal] = v;
+                else if ((v < 0 ? -v : v) > chunk->max_variable) chunk->max_variable = v < 0 ? -v : v;
+                literal++;
+            } else {
+                if (chunk->cnf) chunk->cnf->starts[clause + 1] = literal;
+                clause++;
+            }
+        }
+        if (p < end) p++;
+    }
+    chunk->literals = literal - chunk->literal_at;
+    chunk->clauses = clause - chunk->clause_at;
+    return NULL;
+}
+
+static void dimacs_run(DimacsChunk *chunks, int n) {
+    // dimacs_scan on every chunk, the calling thread does the first
+    pthread_t *threads = malloc(n * sizeof(pthread_t));
+    assert(threads);
+    for (int t = 1; t < n; t++) {
+        // not inside the assert, which -DNDEBUG drops
+        int rc = pthread_create(&threads[t], NULL, dimacs_scan, &chunks[t]);
+        assert(rc == 0);
+        (void) rc;
+    }
+    dimacs_scan(&chunks[0]);
+    for (int t = 1; t < n; t++) pthread_join(threads[t], NULL);
+    free(threads);
+}
+
+static char *dimacs_input(int fd, size_t *size, bool *mapped) {
+    // the whole input, mapped if it's a file and read in otherwise (a pipe)
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            *size = st.st_size;
+            *mapped = true;
+            return data;
+        }
+    }
+    size_t capacity = 1 << 16, used = 0;
+    char *data = malloc(capacity);
+    assert(data);
+    for (ssize_t n; (n = read(fd, data + used, capacity - used)) > 0;) {
+        used += n;
+        if (used == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            assert(data);
+        }
+    }
+    *size = used;
+    *mapped = false;
+    return data;
+}
+
+static bool dimacs_read(const char *path, DimacsCnf *cnf) {
+    /* Params:
+         path - file to read, NULL for stdin
+         cnf - set to the formula, for dimacs_free once done with
+       Return:
+         false if the file can't be opened, has no p cnf line or has a
+         variable past the one on it
+    */
+    int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) return false;
+    size_t size;
+    bool mapped;
+    char *data = dimacs_input(fd, &size, &mapped);
+    if (path) close(fd);
+    const char *p = data, *end = data + size;
+
+    // the header, after any comments
+    while (p < end && *p != 'p') p = dimacs_skip_line(p, end);
+    const char *line_end = p;
+    while (line_end < end && *line_end != '\n') line_end++;
+    long header[2] = {-1, -1};
+    for (int h = 0; p < line_end && h < 2;) {
+        if (dimacs_at_number(p, line_end)) p = dimacs_number(p, line_end, &header[h++]);
+        else p++;
+    }
+    if (header[1] < 0 || header[0] > INT_MAX) {
+        if (mapped) munmap(data, size);
+        else free(data);
+        return false;
+    }
+    cnf->numVariables = header[0];
+    const char *body = dimacs_skip_line(p, end);
+
+    // chunks start at line starts, a clause can still run over into the next
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t length = end - body;
+    int n = length / DIMACS_CHUNK_BYTES + 1;
+    if (n > cores) n = cores > 0 ? cores : 1;
+    DimacsChunk *chunks = calloc(n, sizeof(DimacsChunk));
+    assert(chunks);
+    for (int t = 0; t < n; t++) {
+        chunks[t].begin = t ? chunks[t - 1].end : body;
+        chunks[t].end = t == n - 1 ? end : body + length / n * (t + 1);
+        if (t < n - 1) {
+            if (chunks[t].end < chunks[t].begin) chunks[t].end = chunks[t].begin;
+            // the next chunk should start right after a newline
+            if (chunks[t].end > body && chunks[t].end[-1] != '\n') {
+                chunks[t].end = dimacs_skip_line(chunks[t].end, end);
+            }
+        }
+    }
+    dimacs_run(chunks, n);
+
+    // everything after a % line is dropped
+    size_t literals = 0, clauses = 0;
+    long max_variable = 0;
+    int used = 0;
+    while (used < n) {
+        chunks[used].literal_at = literals;
+        chunks[used].clause_at = clauses;
+        literals += chunks[used].literals;
+        clauses += chunks[used].clauses;
+        if (chunks[used].max_variable > max_variable) max_variable = chunks[used].max_variable;
+        if (chunks[used++].stop) break;
+    }
+    if (max_variable > header[0]) {
+        fprintf(stderr, "variable %ld is past the %ld on the p line\n", max_variable, header[0]);
+        free(chunks);
+        if (mapped) munmap(data, size);
+        else free(data);
+        return false;
+    }
+    cnf->literals = malloc(sizeof(int) * (literals + 1));
+    cnf->starts = malloc(sizeof(size_t) * (clauses + 1));
+    assert(cnf->literals && cnf->starts);
+    cnf->starts[0] = 0;
+    for (int t = 0; t < used; t++) chunks[t].cnf = cnf;
+    dimacs_run(chunks, used);
+    cnf->numClauses = clauses < (unsigned long)header[1] ? clauses : (unsigned long)header[1];
+
+    free(chunks);
+    if (mapped) munmap(data, size);
+    else free(data);
+    return true;
+}
+
+// inline only so that solvers keeping the arrays don't warn about it
+static inline void dimacs_free(DimacsCnf *cnf) {
+    free(cnf->literals);
+    free(cnf->starts);
+    cnf->literals = NULL;
+    cnf->starts = NULL;
+}
+
+#endif
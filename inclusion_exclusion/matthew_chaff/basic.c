@@ -2,12 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include "../dimacs.h"
 
 /****** GLOBAL DATA STRUCTURES ******/
 
 // Any sequence of events you want to cross-check across the basic & optimized
 // solvers can be logged by calling xprintf. It will only log if the LOG_XCHECK
-// flag is set by main(), i.e., if the user passes an argument.
+// flag is set by main(), i.e., if the user passes a flag (an argument starting
+// with -). Any other argument is the file to read instead of stdin.
 int LOG_XCHECK = 0;
 #define xprintf(...) { if (LOG_XCHECK) { fprintf(stderr, __VA_ARGS__); } }
 
@@ -206,12 +208,19 @@ int resolveConflict() {
 }
 
 int main(int argc, char **argv) {
-    LOG_XCHECK = argc > 1;
-    // Read comment lines at the start.
-    for (char c; (c = getc(stdin)) == 'c';)
-        while (getc(stdin) != '\n');
-
-    assert(scanf(" cnf %u %u\n", &N_VARS, &N_CLAUSES) == 2);
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') LOG_XCHECK = 1;
+        else path = argv[i];
+    }
+    // All the clauses' literals are in cnf, which lives as long as they do.
+    DimacsCnf cnf;
+    if (!dimacs_read(path, &cnf)) {
+        fprintf(stderr, "could not read a DIMACS CNF from %s\n", path ? path : "stdin");
+        return 1;
+    }
+    N_VARS = cnf.numVariables;
+    N_CLAUSES = cnf.numClauses;
     N_VARS++;
 
     ASSIGNMENT = malloc(N_VARS * sizeof(ASSIGNMENT[0]));
@@ -224,19 +233,22 @@ int main(int argc, char **argv) {
     LIT_TO_CLAUSES = calloc(N_VARS * 2, sizeof(LIT_TO_CLAUSES[0]));
 
     for (size_t i = 0; i < N_CLAUSES; i++) {
-        int literal = 0;
-        for (assert(scanf("%d ", &literal)); literal; assert(scanf("%d ", &literal))) {
+        // The clause's literal list is its part of cnf, deduplicated in place.
+        CLAUSES[i].literals = cnf.literals + cnf.starts[i];
+        for (size_t l = cnf.starts[i]; l < cnf.starts[i + 1]; l++) {
+            int literal = cnf.literals[l];
             int repeat = 0;
             for (size_t j = 0; j < CLAUSES[i].n_literals && !repeat; j++) {
                 repeat = (CLAUSES[i].literals[j] == literal);
             }
             if (repeat) continue;
-            // Append to the clause's literal list.
+            CLAUSES[i].literals[CLAUSES[i].n_literals++] = literal;
+
+            // Append to the list of clauses touching this literal.
 #define append(obj, field) \
             (obj).n_##field++; \
             (obj).field = realloc((obj).field, (obj).n_##field * sizeof((obj).field[0])); \
             (obj).field[(obj).n_##field - 1]
-            append(CLAUSES[i], literals) = literal;
 
             // Append to the list of clauses touching this literal.
             struct clause_list *list = clauses_touching(literal);
@@ -2,12 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include "../dimacs.h"
 
 /****** GLOBAL DATA STRUCTURES ******/
 
 // Any sequence of events you want to cross-check across the basic & optimized
 // solvers can be logged by calling xprintf. It will only log if the LOG_XCHECK
-// flag is set by main(), i.e., if the user passes an argument.
+// flag is set by main(), i.e., if the user passes a flag (an argument starting
+// with -). Any other argument is the file to read instead of stdin.
 int LOG_XCHECK = 0;
 #define xprintf(...) { if (LOG_XCHECK) { fprintf(stderr, __VA_ARGS__); } }
 
@@ -86,8 +88,14 @@ int is_literal_true(int lit) {
     return ASSIGNMENT[var] != UNASSIGNED && ASSIGNMENT[var] == (lit > 0);
 }
 
-// Called when a solution is found
-int satisfiable() { printf("SAT\n"); }
+// Called when a solution is found. The assignment follows on a "v" line,
+// DIMACS competition style, so that callers can decode the model.
+int satisfiable() {
+    printf("SAT\nv");
+    for (unsigned v = 1; v < N_VARS; v++)
+        printf(" %d", ASSIGNMENT[v] == TRUE ? (int)v : -(int)v);
+    printf(" 0\n");
+}
 
 // Called when it is proved that no solution exists
 int unsatisfiable() { printf("UNSAT\n"); }
@@ -257,12 +265,19 @@ int resolveConflict() {
 }
 
 int main(int argc, char **argv) {
-    LOG_XCHECK = argc > 1;
-    // Read comment lines at the start.
-    for (char c; (c = getc(stdin)) == 'c';)
-        while (getc(stdin) != '\n');
-
-    assert(scanf(" cnf %u %u\n", &N_VARS, &N_CLAUSES) == 2);
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') LOG_XCHECK = 1;
+        else path = argv[i];
+    }
+    // All the clauses' literals are in cnf, which lives as long as they do.
+    DimacsCnf cnf;
+    if (!dimacs_read(path, &cnf)) {
+        fprintf(stderr, "could not read a DIMACS CNF from %s\n", path ? path : "stdin");
+        return 1;
+    }
+    N_VARS = cnf.numVariables;
+    N_CLAUSES = cnf.numClauses;
     N_VARS++;
 
     ASSIGNMENT = malloc(N_VARS * sizeof(ASSIGNMENT[0]));
@@ -278,18 +293,10 @@ int main(int argc, char **argv) {
     IS_BCP_LISTED = calloc(2 * N_VARS, sizeof(IS_BCP_LISTED[0]));
 
     for (size_t i = 0; i < N_CLAUSES; i++) {
-        int literal = 0;
-        for (assert(scanf("%d ", &literal)); literal; assert(scanf("%d ", &literal))) {
-            // Append to the clause's literal list.
-#define append(obj, field) \
-            (obj).n_##field++; \
-            (obj).field = realloc((obj).field, (obj).n_##field * sizeof((obj).field[0])); \
-            (obj).field[(obj).n_##field - 1]
-            append(CLAUSES[i], literals) = literal;
-
-            // TODO: We really need to dedup the literal list. TODO: evaluate
-            // how bad an n^2 thing would hurt us.
-        }
+        CLAUSES[i].literals = cnf.literals + cnf.starts[i];
+        CLAUSES[i].n_literals = cnf.starts[i + 1] - cnf.starts[i];
+        // TODO: We really need to dedup the literal list. TODO: evaluate
+        // how bad an n^2 thing would hurt us.
     }
 
     for (size_t i = 0; i < N_CLAUSES; i++) {